@@ -0,0 +1,118 @@
+/*
+ *  AimPreview.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/31/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "AimPreview.h"
+
+const float AimPreview::ARC_TIME = 3.0f;
+
+// Half the size of the impact cross
+static const float IMPACT_SIZE = 0.3f;
+
+AimPreview::AimPreview()
+{
+	_enabled = true;
+
+	// The arc first, then the three lines of the impact cross. Nothing is ever
+	// added or removed, only overwritten and drawn up to a count.
+	_vertices = new osg::Vec3Array(NUM_ARC_POINTS + 6);
+	_arc = new osg::DrawArrays(osg::PrimitiveSet::LINE_STRIP, 0, 0);
+	_impact = new osg::DrawArrays(osg::PrimitiveSet::LINES, NUM_ARC_POINTS, 0);
+
+	osg::Vec4Array* colors = new osg::Vec4Array(NUM_ARC_POINTS + 6);
+	for (unsigned int i = 0; i < NUM_ARC_POINTS; i++)
+		(*colors)[i] = osg::Vec4(1.0, 0.9, 0.2, 1.0);
+	for (unsigned int i = NUM_ARC_POINTS; i < colors->size(); i++)
+		(*colors)[i] = osg::Vec4(1.0, 0.2, 0.1, 1.0);
+
+	// Same streaming setup as the physics debug lines
+	_geometry = new osg::Geometry();
+	_geometry->setDataVariance(osg::Object::DYNAMIC);
+	_geometry->setUseDisplayList(false);
+	_geometry->setUseVertexBufferObjects(true);
+	_geometry->setVertexArray(_vertices.get());
+	_geometry->setColorArray(colors);
+	_geometry->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
+	_geometry->addPrimitiveSet(_arc.get());
+	_geometry->addPrimitiveSet(_impact.get());
+
+	_geode = new osg::Geode();
+	_geode->addDrawable(_geometry.get());
+
+	osg::StateSet* stateSet = _geode->getOrCreateStateSet();
+	stateSet->setMode(GL_LIGHTING, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+	stateSet->setTextureMode(0, GL_TEXTURE_2D, osg::StateAttribute::OFF);
+	stateSet->setRenderBinDetails(10, "RenderBin");
+}
+
+osg::Node* AimPreview::getNode()
+{
+	return _geode.get();
+}
+
+void AimPreview::setEnabled(bool enabled)
+{
+	_enabled = enabled;
+	_geode->setNodeMask(_enabled ? 0xffffffff : 0x0);
+	std::cout << "Aim preview " << (enabled ? "on" : "off") << std::endl;
+}
+
+bool AimPreview::isEnabled()
+{
+	return _enabled;
+}
+
+void AimPreview::update(const btVector3& position, const btVector3& velocity, btDynamicsWorld* world)
+{
+	if (!_enabled)
+		return;
+
+	btVector3 gravity = world->getGravity();
+	float step = ARC_TIME / (NUM_ARC_POINTS - 1);
+
+	// Walk the arc a segment at a time, asking the world whether anything is in
+	// the way of each one
+	btVector3 from = position;
+	(*_vertices)[0].set(from.x(), from.y(), from.z());
+	unsigned int numPoints = 1;
+	bool hit = false;
+	for (unsigned int i = 1; i < NUM_ARC_POINTS && !hit; i++)
+	{
+		float t = i * step;
+		btVector3 to = position + velocity * t + gravity * (0.5f * t * t);
+
+		btCollisionWorld::ClosestRayResultCallback rayCallback(from, to);
+		world->rayTest(from, to, rayCallback);
+		if (rayCallback.hasHit())
+		{
+			to = rayCallback.m_hitPointWorld;
+			hit = true;
+		}
+
+		(*_vertices)[numPoints++].set(to.x(), to.y(), to.z());
+		from = to;
+	}
+	_arc->setCount(numPoints);
+
+	// A cross where it lands, if it lands within the arc
+	if (hit)
+	{
+		osg::Vec3 impact = (*_vertices)[numPoints - 1];
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			osg::Vec3 offset;
+			offset[axis] = IMPACT_SIZE;
+			(*_vertices)[NUM_ARC_POINTS + axis * 2] = impact - offset;
+			(*_vertices)[NUM_ARC_POINTS + axis * 2 + 1] = impact + offset;
+		}
+	}
+	_impact->setCount(hit ? 6 : 0);
+
+	_vertices->dirty();
+	_geometry->dirtyBound();
+}
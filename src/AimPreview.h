@@ -0,0 +1,51 @@
+/*
+ *  AimPreview.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/31/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _AIMPREVIEW_H_
+#define _AIMPREVIEW_H_
+
+// Shows where the next launch will go: the ballistic arc from the launch point,
+// worked out in closed form as p(t) = p0 + v t + g t^2 / 2, cut short at the
+// first thing a ray cast along it hits, with a small cross at the impact. Mass
+// doesn't come into it; with no drag in the world every mass flies the same arc.
+//
+// The arc and the cross live in one geometry whose arrays are sized once in the
+// constructor and overwritten in place, so updating it every frame is a few
+// dozen evaluations and ray casts with no allocations and one draw call.
+class AimPreview
+{
+public:
+	// Constructor
+	AimPreview();
+
+	// Node holding the arc, add it in the same space as the physics world
+	osg::Node* getNode();
+
+	void setEnabled(bool enabled);
+	bool isEnabled();
+
+	// Recompute the arc for a launch from a position at a velocity under the
+	// world's gravity
+	void update(const btVector3& position, const btVector3& velocity, btDynamicsWorld* world);
+
+private:
+	// Points along the arc and how much flight time they cover
+	static const unsigned int NUM_ARC_POINTS = 64;
+	static const float ARC_TIME;
+
+	// Private variables
+	osg::ref_ptr<osg::Geode> _geode;
+	osg::ref_ptr<osg::Geometry> _geometry;
+	osg::ref_ptr<osg::Vec3Array> _vertices;
+	osg::ref_ptr<osg::DrawArrays> _arc;
+	osg::ref_ptr<osg::DrawArrays> _impact;
+	bool _enabled;
+};
+
+#endif
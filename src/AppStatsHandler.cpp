@@ -0,0 +1,204 @@
+/*
+ *  AppStatsHandler.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 01/02/10.
+ *  Copyright 2010 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "AppStatsHandler.h"
+#include <iomanip>
+#include <sstream>
+
+AppStatsHandler::AppStatsHandler()
+{
+}
+
+#if OPENSCENEGRAPH_MAJOR_VERSION < 3
+
+// The stats camera's coordinate system, and the built-in page's character
+// size and time scale in pixels per second. Our labels are longer than the
+// built-in ones, so the values and bars start further right.
+static const float STATS_WIDTH = 1280.0f;
+static const float STATS_HEIGHT = 1024.0f;
+static const float CHARACTER_SIZE = 20.0f;
+static const float BLOCK_MULTIPLIER = 10000.0f;
+static const float LEFT_POS = 10.0f;
+static const float VALUE_POS = 170.0f;
+static const float START_BLOCKS = 250.0f;
+
+// Where our lines start, clear of the built-in viewer bars above them
+static const float TOP_POS = 650.0f;
+static const float LINE_HEIGHT = CHARACTER_SIZE * 1.4f;
+
+// Frames drawn per bar line, as on the built-in page
+static const unsigned int NUM_FRAMES = 8;
+
+void AppStatsHandler::addUserStatsLine(const std::string& label, const osg::Vec4& textColor, const osg::Vec4& barColor,
+									   const std::string& timeTakenName, float multiplier, bool average, bool averageInInverseSpace,
+									   const std::string& beginTimeName, const std::string& endTimeName, float maxValue)
+{
+	(void)maxValue;
+
+	UserLine line;
+	line.label = label;
+	line.textColor = textColor;
+	line.barColor = barColor;
+	line.timeTakenName = timeTakenName;
+	line.multiplier = multiplier;
+	line.average = average;
+	line.averageInInverseSpace = averageInInverseSpace;
+	line.beginTimeName = beginTimeName;
+	line.endTimeName = endTimeName;
+	_userLines.push_back(line);
+
+	// Lines added after the page is up need their text too
+	if (_userCamera.valid())
+	{
+		getCamera()->removeChild(_userCamera.get());
+		_userCamera = NULL;
+	}
+}
+
+bool AppStatsHandler::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa)
+{
+	bool handled = osgViewer::StatsHandler::handle(ea, aa);
+
+	// The base class builds its camera on the first key press
+	if (!_userCamera.valid() && _initialized && getCamera() != NULL && !_userLines.empty())
+		_setUp();
+	if (!_userCamera.valid())
+		return handled;
+
+	// Only on the viewer page, the later pages use the space below the bars
+	bool visible = (_statsType == VIEWER_STATS);
+	_userCamera->setNodeMask(visible ? 0xffffffff : 0x0);
+
+	osgViewer::View* view = dynamic_cast<osgViewer::View*>(&aa);
+	if (visible && ea.getEventType() == osgGA::GUIEventAdapter::FRAME && view != NULL && view->getViewerBase() != NULL)
+		_update(view->getViewerBase()->getViewerStats());
+
+	return handled;
+}
+
+void AppStatsHandler::_setUp()
+{
+	_userCamera = new osg::Camera();
+	_userCamera->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+	_userCamera->setRenderOrder(osg::Camera::NESTED_RENDER);
+	_userCamera->setClearMask(0);
+	_userCamera->setProjectionMatrixAsOrtho2D(0, STATS_WIDTH, 0, STATS_HEIGHT);
+	_userCamera->setViewMatrix(osg::Matrix::identity());
+	_userCamera->setAllowEventFocus(false);
+
+	_userGeode = new osg::Geode();
+	osg::StateSet* stateSet = _userGeode->getOrCreateStateSet();
+	stateSet->setMode(GL_LIGHTING, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+	stateSet->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF);
+	stateSet->setAttributeAndModes(new osg::Program(), osg::StateAttribute::ON | osg::StateAttribute::PROTECTED);
+	_userCamera->addChild(_userGeode.get());
+
+	// All the bars are one geometry, rewritten every frame while it shows
+	unsigned int maxVertices = _userLines.size() * NUM_FRAMES * 4;
+	_vertices = new osg::Vec3Array(maxVertices);
+	_colors = new osg::Vec4Array(maxVertices);
+	_quads = new osg::DrawArrays(osg::PrimitiveSet::QUADS, 0, 0);
+	_bars = new osg::Geometry();
+	_bars->setDataVariance(osg::Object::DYNAMIC);
+	_bars->setUseDisplayList(false);
+	_bars->setVertexArray(_vertices.get());
+	_bars->setColorArray(_colors.get());
+	_bars->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
+	_bars->addPrimitiveSet(_quads.get());
+	_userGeode->addDrawable(_bars.get());
+
+	for (unsigned int i = 0; i < _userLines.size(); i++)
+	{
+		UserLine& line = _userLines[i];
+		float y = TOP_POS - i * LINE_HEIGHT;
+
+		osgText::Text* label = new osgText::Text();
+		label->setCharacterSize(CHARACTER_SIZE);
+		label->setColor(line.textColor);
+		label->setPosition(osg::Vec3(LEFT_POS, y, 0.0f));
+		label->setText(line.label);
+		_userGeode->addDrawable(label);
+
+		line.value = new osgText::Text();
+		line.value->setDataVariance(osg::Object::DYNAMIC);
+		line.value->setCharacterSize(CHARACTER_SIZE);
+		line.value->setColor(line.textColor);
+		line.value->setPosition(osg::Vec3(VALUE_POS, y, 0.0f));
+		line.valueText.clear();
+		_userGeode->addDrawable(line.value.get());
+	}
+
+	getCamera()->addChild(_userCamera.get());
+}
+
+void AppStatsHandler::_update(osg::Stats* stats)
+{
+	if (stats == NULL)
+		return;
+
+	unsigned int latest = stats->getLatestFrameNumber();
+	unsigned int first = stats->getEarliestFrameNumber();
+	if (latest >= first + NUM_FRAMES)
+		first = latest - NUM_FRAMES + 1;
+
+	// Bars are placed relative to the oldest frame drawn, like the built-in ones
+	double referenceTime = 0.0;
+	bool haveReference = stats->getAttribute(first, "Reference time", referenceTime);
+
+	unsigned int numVertices = 0;
+	for (unsigned int i = 0; i < _userLines.size(); i++)
+	{
+		UserLine& line = _userLines[i];
+		float y = TOP_POS - i * LINE_HEIGHT;
+
+		double value = 0.0;
+		bool haveValue = line.average ?
+			stats->getAveragedAttribute(first, latest, line.timeTakenName, value, line.averageInInverseSpace) :
+			stats->getAttribute(latest, line.timeTakenName, value);
+
+		// Only rebuild the glyphs when the text actually changes
+		std::ostringstream text;
+		if (haveValue)
+			text << std::fixed << std::setprecision(2) << value * line.multiplier;
+		if (text.str() != line.valueText)
+		{
+			line.valueText = text.str();
+			line.value->setText(line.valueText);
+		}
+
+		if (!haveReference || line.beginTimeName.empty() || line.endTimeName.empty())
+			continue;
+
+		for (unsigned int frame = first; frame <= latest; frame++)
+		{
+			double begin, end;
+			if (!stats->getAttribute(frame, line.beginTimeName, begin) || !stats->getAttribute(frame, line.endTimeName, end))
+				continue;
+
+			float left = START_BLOCKS + (begin - referenceTime) * BLOCK_MULTIPLIER;
+			float right = osg::maximum(START_BLOCKS + float(end - referenceTime) * BLOCK_MULTIPLIER, left + 1.0f);
+			float bottom = y;
+			float top = y + CHARACTER_SIZE;
+			(*_vertices)[numVertices + 0].set(left, top, 0.0f);
+			(*_vertices)[numVertices + 1].set(left, bottom, 0.0f);
+			(*_vertices)[numVertices + 2].set(right, bottom, 0.0f);
+			(*_vertices)[numVertices + 3].set(right, top, 0.0f);
+			for (unsigned int v = 0; v < 4; v++)
+				(*_colors)[numVertices + v] = line.barColor;
+			numVertices += 4;
+		}
+	}
+
+	_quads->setCount(numVertices);
+	_vertices->dirty();
+	_colors->dirty();
+	_bars->dirtyBound();
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ *  AppStatsHandler.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 01/02/10.
+ *  Copyright 2010 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _APPSTATSHANDLER_H_
+#define _APPSTATSHANDLER_H_
+
+// osgViewer's StatsHandler plus the app's own stats lines. OSG 3.0 has user
+// stats lines built in, so there this is the plain StatsHandler. OSG 2.8 has
+// none, so the same addUserStatsLine() is provided here: the lines are drawn
+// on the viewer stats page, below the built-in bars, in the same layout. Each
+// line shows its value as text and, when it has begin and end attributes, a
+// bar per frame for the last few frames on the same time scale as the
+// built-in ones.
+class AppStatsHandler : public osgViewer::StatsHandler
+{
+public:
+	// Constructor
+	AppStatsHandler();
+
+#if OPENSCENEGRAPH_MAJOR_VERSION < 3
+	// Same arguments as OSG 3.0's StatsHandler::addUserStatsLine. The value is
+	// read from timeTakenName and multiplied for display; leave the begin and
+	// end names empty for a line without bars. maxValue is only used by 3.0.
+	void addUserStatsLine(const std::string& label, const osg::Vec4& textColor, const osg::Vec4& barColor,
+						  const std::string& timeTakenName, float multiplier, bool average, bool averageInInverseSpace,
+						  const std::string& beginTimeName, const std::string& endTimeName, float maxValue);
+
+	virtual bool handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa);
+
+private:
+	struct UserLine
+	{
+		std::string label;
+		osg::Vec4 textColor;
+		osg::Vec4 barColor;
+		std::string timeTakenName;
+		float multiplier;
+		bool average;
+		bool averageInInverseSpace;
+		std::string beginTimeName;
+		std::string endTimeName;
+		osg::ref_ptr<osgText::Text> value;
+		std::string valueText;
+	};
+
+	// Build the lines' camera under the stats camera, once the base class has made it
+	void _setUp();
+
+	// Refill the bars and values from the viewer stats
+	void _update(osg::Stats* stats);
+
+	// Private variables
+	std::vector<UserLine> _userLines;
+	osg::ref_ptr<osg::Camera> _userCamera;
+	osg::ref_ptr<osg::Geode> _userGeode;
+	osg::ref_ptr<osg::Geometry> _bars;
+	osg::ref_ptr<osg::Vec3Array> _vertices;
+	osg::ref_ptr<osg::Vec4Array> _colors;
+	osg::ref_ptr<osg::DrawArrays> _quads;
+#endif
+};
+
+#endif
@@ -8,19 +8,63 @@
  */
 
 #include "BDScene.h"
+#include "ModelCache.h"
+#include "GLObjectCompiler.h"
 
 extern float _navSpeed;
 
+// Marks everything under a node as static or dynamic, unless it already says
+// otherwise. Statesets and drawables that are known to change keep DYNAMIC.
+class DataVarianceVisitor : public osg::NodeVisitor
+{
+public:
+	DataVarianceVisitor(osg::Object::DataVariance variance) : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN), _variance(variance) {}
+	
+	virtual void apply(osg::Node& node)
+	{
+		_mark(&node);
+		_mark(node.getStateSet());
+		traverse(node);
+	}
+	
+	virtual void apply(osg::Geode& geode)
+	{
+		for (unsigned int i = 0; i < geode.getNumDrawables(); i++)
+		{
+			_mark(geode.getDrawable(i));
+			_mark(geode.getDrawable(i)->getStateSet());
+		}
+		apply((osg::Node&)geode);
+	}
+	
+private:
+	void _mark(osg::Object* object)
+	{
+		if (object && object->getDataVariance() == osg::Object::UNSPECIFIED)
+			object->setDataVariance(_variance);
+	}
+	
+	osg::Object::DataVariance _variance;
+};
+
 BDScene::BDScene()
 {
 	// Create the device and network input controllers
 	_deviceInputController = new DeviceInputController();
+	_physicsProfiler = new PhysicsProfiler();
+	_physicsDebugDrawer = new PhysicsDebugDrawer();
+	_aimPreview = new AimPreview();
 
 	// Initialize the audio manager and audio flags
 	_isMaster = false;
 	_totalTime = 0.0;
 	_aimingVector = osg::Vec3(1, -7, -10);
 	_mass = 3.0;
+	_useInstancedBoxes = true;
+	_wallColumns = 20;
+	_wallRows = 12;
+	_wallLayers = 1;
+	_occlusionCulling = false;
 	
 	// Register listening keys with KVReflector
 	aq::KVReflector::instance()->addObserverWithKey(this, "Update_Wand_Matrix");
@@ -35,6 +79,11 @@ BDScene::BDScene()
 	aq::KVReflector::instance()->addObserverWithKey(this, "Mass_2");
 	aq::KVReflector::instance()->addObserverWithKey(this, "Mass_3");
 	aq::KVReflector::instance()->addObserverWithKey(this, "Reset_Scene");
+	aq::KVReflector::instance()->addObserverWithKey(this, "Toggle_Debug_Draw");
+	aq::KVReflector::instance()->addObserverWithKey(this, "Toggle_Occlusion_Culling");
+	aq::KVReflector::instance()->addObserverWithKey(this, "Toggle_Shader_Lighting");
+	aq::KVReflector::instance()->addObserverWithKey(this, "Toggle_Shadows");
+	aq::KVReflector::instance()->addObserverWithKey(this, "Toggle_Aim_Preview");
 }
 
 void BDScene::setMaster(bool isMaster)
@@ -62,36 +111,73 @@ void BDScene::init()
 	_models = new osg::Group();
 	_wandTrans = new osg::MatrixTransform();
 	
-	_boxes = new osg::Group();
-	_launchedObjects = new osg::Group();
+	_boxes = new SpatialGridGroup(InstancedBoxes::WALL_CELL_SIZE);
+	_launchedObjects = new SpatialGridGroup();
+	
+	_environment = new osg::Group();
 	
+	_models->addChild(_environment.get());
 	_models->addChild(_launchedObjects.get());
 	_models->addChild(_boxes.get());
 	
-	// Set the models node to normal scaling
-	_models->getOrCreateStateSet()->setMode(GL_NORMALIZE, osg::StateAttribute::ON);
-	_launchedObjects->getOrCreateStateSet()->setMode(GL_NORMALIZE, osg::StateAttribute::ON);
+	// The whole wall in one draw call
+	float boxSize = 0.5;
+	_instancedBoxes = new InstancedBoxes(osg::Vec3(boxSize, boxSize, boxSize));
+	_models->addChild(_instancedBoxes.get());
 	
 	// Setup the scenegraph hierarchy
 	_rootNode->addChild(_navTrans.get());
 	_navTrans->addChild(_models.get());
 	_models->addChild(_wandTrans.get());
 	
+	// Both follow the user every frame
+	_navTrans->setDataVariance(osg::Object::DYNAMIC);
+	_wandTrans->setDataVariance(osg::Object::DYNAMIC);
+	
+	// The ground never moves, it gets flattened and merged once here and
+	// survives scene resets
+	_addStaticSubtree(_environment.get(), _createGround());
+	
+	// The physics debug lines live in the same space as the bodies
+	_navTrans->addChild(_physicsDebugDrawer->getNode());
+	_navTrans->addChild(_aimPreview->getNode());
+	
 	initPhysics();
 	setupBoxes();
 	
+	// Start loading everything we launch in the background
+	osgDB::getDataFilePathList().push_back("/Users/brandon/Programming/OpenSceneGraph-Data-2.8.0");
+	ModelCache::instance().preload("glider.osg");
+	
 	// Initialize the lights group for KVO notifications
 	_lightsGroup = new LightsGroup(_models->getOrCreateStateSet());
 	
 	// Add the lighting to the scene
 	_lightsGroup->init();
 	_navTrans->addChild(_lightsGroup.get());
+	
+	// Light the models in a shader, which also takes care of normal scaling
+	setShaderLightingEnabled(true);
+	
+	// These change at run time (lighting, shadow and quality toggles). Marking them
+	// DYNAMIC keeps a multithreaded viewer from drawing them while they change.
+	_rootNode->getOrCreateStateSet()->setDataVariance(osg::Object::DYNAMIC);
+	_models->getOrCreateStateSet()->setDataVariance(osg::Object::DYNAMIC);
+	_launchedObjects->getOrCreateStateSet()->setDataVariance(osg::Object::DYNAMIC);
 
-	// Run optimization over the scene graph.
-	// NOTE: Using the optimizer may cause problems with textures not showing
-	// up on all walls.
-	osgUtil::Optimizer optimizer;
-	optimizer.optimize(_rootNode.get());
+	// Shadows from the key light, cast by everything that moves. The map is
+	// only re-rendered while bodies are awake, see update().
+	_shadowMap = new ShadowMap(_models->getOrCreateStateSet());
+	_shadowMap->setLight(1);
+	_shadowMap->setLightPosition(_lightsGroup->getLightPosition(1));
+	_shadowMap->setRegion(osg::Vec3(0, _wallRows * 0.5, -5), osg::Vec2(_wallColumns, _wallRows).length() + 10.0);
+	_shadowMap->addChild(_boxes.get());
+	_shadowMap->addChild(_instancedBoxes.get());
+	_shadowMap->addChild(_launchedObjects.get());
+	_rootNode->addChild(_shadowMap.get());
+	
+	// Have every context compile the whole scene before its first frame
+	GLObjectCompiler::instance().add(_rootNode.get());
 }
 
 void BDScene::initPhysics()
@@ -109,6 +195,7 @@ void BDScene::initPhysics()
 	
 	_dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
 	_dynamicsWorld->setGravity(btVector3(0, -9.8, 0));
+	_dynamicsWorld->setDebugDrawer(_physicsDebugDrawer);
 	
 	btCollisionShape *groundShape = new btStaticPlaneShape(btVector3(0, 1, 0), 1);
 	
@@ -117,8 +204,6 @@ void BDScene::initPhysics()
 	groundRigidBodyCI(0,groundMotionState,groundShape,btVector3(0,0,0));
 	btRigidBody* groundRigidBody = new btRigidBody(groundRigidBodyCI);
 	_dynamicsWorld->addRigidBody(groundRigidBody);
-	
-	_models->addChild(createOSGBox(osg::Vec3(10000,.1,10000)));
 }
 
 void BDScene::setupBoxes()
@@ -127,38 +212,118 @@ void BDScene::setupBoxes()
 	// this is suggested in the bullet wiki
 	float boxSize = 0.5;
 	osg::ref_ptr<osg::MatrixTransform> node = createOSGBox(osg::Vec3(boxSize, boxSize, boxSize));
+	osg::ref_ptr<osg::Node> boxGeode = node->getChild(0);
+	DataVarianceVisitor markStatic(osg::Object::STATIC);
+	boxGeode->accept(markStatic);
 	btCollisionShape *cShape = osgbBullet::btBoxCollisionShapeFromOSG(node.get());	
 	btScalar mass(30.0);
 	btVector3 inertia;
 	cShape->calculateLocalInertia(mass, inertia);
 	
-	for (int i=-10; i < 10; i++)
+	for (int i = -_wallColumns / 2; i < _wallColumns - _wallColumns / 2; i++)
 	{
-		for (int j=0; j < 12; j++)
+		for (int j=0; j < _wallRows; j++)
 		{
-			// put each box in its place
-			osg::ref_ptr<osg::MatrixTransform> boxClone = createOSGBox(osg::Vec3(boxSize, boxSize, boxSize));
-			osgbBullet::MotionState *motion = new osgbBullet::MotionState;
-			motion->setTransform(boxClone.get());
-			
-			btTransform shapeTransform;
-			shapeTransform.setIdentity();
-			shapeTransform.setOrigin(btVector3(i, j+0.5, -5)); // change this to move the initial position of the object
-			motion->setWorldTransform(shapeTransform);
-			
-			btRigidBody::btRigidBodyConstructionInfo rbinfo(mass, motion, cShape, inertia);
-			btRigidBody *body = new btRigidBody(rbinfo);
-			_dynamicsWorld->addRigidBody(body);
-			
-			_boxes->addChild(boxClone.get());
+			for (int k=0; k < _wallLayers; k++)
+			{
+				btTransform shapeTransform;
+				shapeTransform.setIdentity();
+				shapeTransform.setOrigin(btVector3(i, j+0.5, -5 - k)); // change this to move the initial position of the object
+				
+				btMotionState *motion = NULL;
+				osg::ref_ptr<osg::MatrixTransform> boxClone;
+				if (_useInstancedBoxes)
+				{
+					// the instanced wall hands out motion states that write straight into its matrix buffer
+					motion = _instancedBoxes->addInstance(shapeTransform);
+				}
+				else
+				{
+					// every box draws the same geode, the grid puts it in its place
+					boxClone = new osg::MatrixTransform();
+					boxClone->setDataVariance(osg::Object::DYNAMIC);
+					boxClone->addChild(boxGeode.get());
+				}
+				
+				btRigidBody::btRigidBodyConstructionInfo rbinfo(mass, motion, cShape, inertia);
+				rbinfo.m_startWorldTransform = shapeTransform;
+				btRigidBody *body = new btRigidBody(rbinfo);
+				_dynamicsWorld->addRigidBody(body);
+				
+				// Same grid as the launched objects, so the boxes move in parallel and
+				// a knocked over box is filed under the cell it lands in
+				if (boxClone.valid())
+					_boxes->addObject(boxClone.get(), body);
+			}
 		}
 	}
 }
 
+void BDScene::setWallSize(int columns, int rows, int layers)
+{
+	_wallColumns = columns;
+	_wallRows = rows;
+	_wallLayers = layers;
+}
+
+void BDScene::setUseInstancedBoxes(bool useInstancing)
+{
+	_useInstancedBoxes = useInstancing;
+}
+
+void BDScene::setOcclusionCullingEnabled(bool enabled)
+{
+	_occlusionCulling = enabled;
+	_instancedBoxes->setOcclusionCulling(enabled);
+	_launchedObjects->setOcclusionCulling(enabled);
+	_boxes->setOcclusionCulling(enabled);
+	
+	std::cout << "Occlusion culling " << (enabled ? "on" : "off") << std::endl;
+}
+
+bool BDScene::isOcclusionCullingEnabled()
+{
+	return _occlusionCulling;
+}
+
+void BDScene::setShaderLightingEnabled(bool enabled)
+{
+	_lightsGroup->setShaderLightingEnabled(enabled);
+	
+	// The fixed function lights need GL_NORMALIZE for the scaled wand and the
+	// launched models, the shader normalizes on its own
+	osg::StateAttribute::Values normalize = enabled ? osg::StateAttribute::OFF : osg::StateAttribute::ON;
+	_models->getOrCreateStateSet()->setMode(GL_NORMALIZE, normalize);
+	_launchedObjects->getOrCreateStateSet()->setMode(GL_NORMALIZE, normalize);
+	
+	std::cout << "Shader lighting " << (enabled ? "on" : "off") << std::endl;
+}
+
+bool BDScene::isShaderLightingEnabled()
+{
+	return _lightsGroup->isShaderLightingEnabled();
+}
+
+void BDScene::setShadowsEnabled(bool enabled)
+{
+	_shadowMap->setShadowsEnabled(enabled);
+	std::cout << "Shadows " << (enabled ? "on" : "off") << std::endl;
+}
+
+bool BDScene::areShadowsEnabled()
+{
+	return _shadowMap->getShadowsEnabled();
+}
+
 void BDScene::dropBall()
 {
 	std::cout << "Launching ball with axis " << _aimingVector.x() << ", " << _aimingVector.y() << ", " << _aimingVector.z() << std::endl;
-	osg::ref_ptr<osg::Node> nodeDB = osgDB::readNodeFile("/Users/brandon/Programming/OpenSceneGraph-Data-2.8.0/glider.osg");
+	launchObject(osg::Vec3(0, 0, 0), _aimingVector);
+}
+
+void BDScene::launchObject(const osg::Vec3& position, const osg::Vec3& velocity)
+{
+	osg::ref_ptr<osg::Node> nodeDB = ModelCache::instance().getModel("glider.osg");
 	osg::ref_ptr<osg::MatrixTransform> node = new osg::MatrixTransform();
 	
 	if (nodeDB != NULL)
@@ -169,32 +334,37 @@ void BDScene::dropBall()
 		return;
 	}
 
-	osgbBullet::MotionState *motion = new osgbBullet::MotionState;
-	motion->setTransform(node.get());
+	// Only the most detailed level goes into the hull, the rest are copies of it
 	static btCollisionShape *cShape;
 	if (cShape == NULL)
-		cShape = osgbBullet::btConvexTriMeshCollisionShapeFromOSG(node.get());
+		cShape = osgbBullet::btConvexTriMeshCollisionShapeFromOSG(LODGenerator::getHighestDetail(nodeDB.get()));
 //	osg::Node* debugNode = osgbBullet::osgNodeFromBtCollisionShape( cShape );
 //    node->addChild( debugNode );
 	
 	btTransform shapeTransform;
 	shapeTransform.setIdentity();
-	shapeTransform.setOrigin(btVector3(0, 0, 0)); // change this to move the initial position of the object
-	motion->setWorldTransform(shapeTransform);
+	shapeTransform.setOrigin(btVector3(position.x(), position.y(), position.z()));
 	
+	// The grid gives the body its motion state when the node is added below
 	btVector3 inertia;
 	cShape->calculateLocalInertia(_mass, inertia);
-	btRigidBody::btRigidBodyConstructionInfo rbinfo(_mass, motion, cShape, inertia);
+	btRigidBody::btRigidBodyConstructionInfo rbinfo(_mass, NULL, cShape, inertia);
+	rbinfo.m_startWorldTransform = shapeTransform;
 	btRigidBody *body = new btRigidBody(rbinfo);
-	body->setLinearVelocity( btVector3( _aimingVector.x(), _aimingVector.y(), _aimingVector.z() ) );
+	body->setLinearVelocity( btVector3( velocity.x(), velocity.y(), velocity.z() ) );
 	body->setAngularVelocity( btVector3( 1, 0, 0 ) );
 	_dynamicsWorld->addRigidBody(body);
 	
-	_launchedObjects->addChild(node.get());
+	// Filed by where its body is, so far away launches cull as a block
+	node->setDataVariance(osg::Object::DYNAMIC);
+	_launchedObjects->addObject(node.get(), body);
+	GLObjectCompiler::instance().add(node.get());
 }
 
 void BDScene::didChangeValueForKey(double value, aq::String key)
 {
+	PhaseTimer::Scope kvoScope(PhaseTimer::KVO);
+	
 	if (key == "Update_Wand_Matrix")
 	{
 		osg::Vec3 direction(_wandMatrix.ptr()[8], _wandMatrix.ptr()[9],_wandMatrix.ptr()[10]);
@@ -249,13 +419,34 @@ void BDScene::didChangeValueForKey(double value, aq::String key)
 		std::cout << "Resetting scene" << std::endl;
 		_resetScene();
 	}
+	else if (key == "Toggle_Debug_Draw")
+	{
+		setDebugDrawEnabled(!isDebugDrawEnabled());
+	}
+	else if (key == "Toggle_Occlusion_Culling")
+	{
+		setOcclusionCullingEnabled(!isOcclusionCullingEnabled());
+	}
+	else if (key == "Toggle_Shader_Lighting")
+	{
+		setShaderLightingEnabled(!isShaderLightingEnabled());
+	}
+	else if (key == "Toggle_Shadows")
+	{
+		setShadowsEnabled(!areShadowsEnabled());
+	}
+	else if (key == "Toggle_Aim_Preview")
+	{
+		setAimPreviewEnabled(!isAimPreviewEnabled());
+	}
 }
 
 void BDScene::_resetScene()
 {
 	// Remove OSG objects
-	_launchedObjects->removeChildren(0, _launchedObjects->getNumChildren());
-	_boxes->removeChildren(0, _boxes->getNumChildren());
+	_launchedObjects->clear();
+	_boxes->clear();
+	_instancedBoxes->clear();
 	
 	// Remove Bullet objects by creating a new dynamics world
 	delete _dynamicsWorld;
@@ -290,6 +481,8 @@ osg::Matrixf BDScene::getWandMatrix()
 void BDScene::setNavigationMatrix(osg::Matrixf matrix)
 {
 	_navTrans->setMatrix(matrix);
+	_lightsGroup->setNavigationMatrix(matrix);
+	_shadowMap->setNavigationMatrix(matrix);
 }
 
 osg::Matrixf BDScene::getNavigationMatrix()
@@ -302,11 +495,59 @@ osg::Group* BDScene::getRootNode()
 	return _rootNode.get();
 }
 
+SpatialGridGroup* BDScene::getLaunchedObjects()
+{
+	return _launchedObjects.get();
+}
+
+SpatialGridGroup* BDScene::getBoxes()
+{
+	return _boxes.get();
+}
+
 osg::Group* BDScene::getModels()
 {
 	return _models.get();
 }
 
+PhysicsProfiler* BDScene::getPhysicsProfiler()
+{
+	return _physicsProfiler;
+}
+
+void BDScene::setDebugDrawEnabled(bool enabled)
+{
+	_physicsDebugDrawer->setEnabled(enabled);
+}
+
+bool BDScene::isDebugDrawEnabled()
+{
+	return _physicsDebugDrawer->isEnabled();
+}
+
+void BDScene::setDebugDrawSuppressed(bool suppressed)
+{
+	_physicsDebugDrawer->setSuppressed(suppressed);
+}
+
+void BDScene::setAimPreviewEnabled(bool enabled)
+{
+	_aimPreview->setEnabled(enabled);
+}
+
+bool BDScene::isAimPreviewEnabled()
+{
+	return _aimPreview->isEnabled();
+}
+
+std::string BDScene::findDataFile(std::string name)
+{
+	std::string path = osgDB::findDataFile(name);
+	if (path.empty())
+		std::cout << "Could not find data file " << name << std::endl;
+	return path;
+}
+
 void BDScene::buttonInput(int button, bool pressed)
 {
 	_deviceInputController->buttonInput(button, pressed);
@@ -318,13 +559,87 @@ void BDScene::update(double dt)
 	_totalTime += dt;
 	
 	// Process all device inputs
+	PhaseTimer& phaseTimer = PhaseTimer::instance();
+	phaseTimer.begin(PhaseTimer::INPUT);
 	_deviceInputController->update(dt);
-	
-	// Update lighting
-//	_lightsGroup->updateLights(_totalTime);
+	phaseTimer.end(PhaseTimer::INPUT);
 	
 	// update physics
+	phaseTimer.begin(PhaseTimer::PHYSICS);
+	_physicsProfiler->beginStep();
 	_dynamicsWorld->stepSimulation(dt, 2);
+	_physicsProfiler->endStep();
+	phaseTimer.end(PhaseTimer::PHYSICS);
+	
+	// Everything from here on brings the scene graph up to date
+	PhaseTimer::Scope sceneScope(PhaseTimer::SCENE);
+	
+	// Update lighting
+	_lightsGroup->updateLights(_totalTime);
+	
+	// Move launched objects and the non-instanced wall into place, across cores
+	_launchedObjects->update();
+	_boxes->update();
+	
+	// Upload the instanced wall's transforms in one go
+	_instancedBoxes->update();
+	
+	// Rebuild the debug lines, this is a no-op while the overlay is off
+	_physicsDebugDrawer->update(_dynamicsWorld);
+	
+	// Where dropBall would send the next glider
+	_aimPreview->update(btVector3(0, 0, 0), btVector3(_aimingVector.x(), _aimingVector.y(), _aimingVector.z()), _dynamicsWorld);
+	
+	// The shader brings the lights into eye space with this
+	_lightsGroup->setNavigationMatrix(_navTrans->getMatrix());
+	
+	// Redraw the shadow map only if something could have moved
+	_shadowMap->setLightPosition(_lightsGroup->getLightPosition(_shadowMap->getLight()));
+	_shadowMap->setNavigationMatrix(_navTrans->getMatrix());
+	_shadowMap->update(getNumActiveBodies() > 0);
+}
+
+int BDScene::getNumActiveBodies()
+{
+	int numActive = 0;
+	btCollisionObjectArray& objects = _dynamicsWorld->getCollisionObjectArray();
+	for (int i = 0; i < objects.size(); i++)
+	{
+		if (!objects[i]->isStaticOrKinematicObject() && objects[i]->isActive())
+			numActive++;
+	}
+	return numActive;
+}
+
+void BDScene::_addStaticSubtree(osg::Group* parent, osg::Node* subtree)
+{
+	DataVarianceVisitor markStatic(osg::Object::STATIC);
+	subtree->accept(markStatic);
+	
+	// Only the subtree is touched, and texture settings are left alone since
+	// they used to go missing on some walls when the whole graph was optimized
+	osgUtil::Optimizer optimizer;
+	optimizer.optimize(subtree, osgUtil::Optimizer::FLATTEN_STATIC_TRANSFORMS |
+								osgUtil::Optimizer::REMOVE_REDUNDANT_NODES |
+								osgUtil::Optimizer::MERGE_GEODES |
+								osgUtil::Optimizer::MERGE_GEOMETRY |
+								osgUtil::Optimizer::SHARE_DUPLICATE_STATE |
+								osgUtil::Optimizer::CHECK_GEOMETRY);
+	
+	LightsGroup::prepareForShader(subtree);
+	parent->addChild(subtree);
+}
+
+osg::Node* BDScene::_createGround()
+{
+	// A quad rather than a box so the optimizer can flatten and merge it. The
+	// top sits where the old ground box's did.
+	osg::Geometry* quad = osg::createTexturedQuadGeometry(osg::Vec3(-10000, .1, 10000), osg::Vec3(20000, 0, 0), osg::Vec3(0, 0, -20000));
+	
+	osg::Geode* geode = new osg::Geode();
+	geode->addDrawable(quad);
+	
+	return geode;
 }
 
 osg::MatrixTransform* BDScene::createOSGBox( osg::Vec3 size )
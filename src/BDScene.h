@@ -12,6 +12,13 @@
 
 #include "LightsGroup.h"
 #include "DeviceInputController.h"
+#include "PhysicsProfiler.h"
+#include "PhaseTimer.h"
+#include "PhysicsDebugDrawer.h"
+#include "AimPreview.h"
+#include "InstancedBoxes.h"
+#include "ShadowMap.h"
+#include "SpatialGridGroup.h"
 
 
 class BDScene : public aq::KVObserver
@@ -45,6 +52,8 @@ public:
 	// Accessors for scenegraph nodes
 	osg::Group* getRootNode();
 	osg::Group* getModels();
+	SpatialGridGroup* getLaunchedObjects();
+	SpatialGridGroup* getBoxes();
 	
 	// Error checking version of OSG"s finddatafile function
 	static std::string findDataFile(std::string name);
@@ -52,6 +61,33 @@ public:
 	// Update method called in every juggler latePreFrame and every GLUT display
 	void update(double dt);
 	
+	// Per-stage timing of the last stepSimulation
+	PhysicsProfiler* getPhysicsProfiler();
+	
+	// Collision geometry overlay
+	void setDebugDrawEnabled(bool enabled);
+	bool isDebugDrawEnabled();
+	void setDebugDrawSuppressed(bool suppressed);
+	
+	// Arc showing where the next launch will land, on by default
+	void setAimPreviewEnabled(bool enabled);
+	bool isAimPreviewEnabled();
+	
+	// Hardware occlusion queries on the wall, off by default
+	void setOcclusionCullingEnabled(bool enabled);
+	bool isOcclusionCullingEnabled();
+	
+	// Lighting in a shader instead of fixed function, on by default
+	void setShaderLightingEnabled(bool enabled);
+	bool isShaderLightingEnabled();
+	
+	// Shadows need the shader lighting, they're ignored by the fixed function path
+	void setShadowsEnabled(bool enabled);
+	bool areShadowsEnabled();
+	
+	// Bodies that aren't asleep, anything that moved this step is one of these
+	int getNumActiveBodies();
+	
 	// Update button info
 	void buttonInput(int button, bool pressed);
 	
@@ -60,31 +96,53 @@ public:
 	void moveDown();
 	
 	void dropBall();
+	
+	// Launch the glider from anywhere, dropBall() fires it from the origin along the aiming vector
+	void launchObject(const osg::Vec3& position, const osg::Vec3& velocity);
 	void setupBoxes();
 	
+	// Size of the box wall and whether it's drawn instanced, set these before init()
+	void setWallSize(int columns, int rows, int layers);
+	void setUseInstancedBoxes(bool useInstancing);
+	
 private:
 	
 	void _resetScene();
 	osg::MatrixTransform* createOSGBox( osg::Vec3 size );
 	
+	// Put static content under a parent after flattening and merging it
+	void _addStaticSubtree(osg::Group* parent, osg::Node* subtree);
+	osg::Node* _createGround();
+	
 	osg::Vec3 _aimingVector;
 	btScalar _mass;
 	
 	// Private variables
 	DeviceInputController* _deviceInputController;
+	PhysicsProfiler* _physicsProfiler;
+	PhysicsDebugDrawer* _physicsDebugDrawer;
+	AimPreview* _aimPreview;
 	osg::ref_ptr<osg::Group> _rootNode;
 	osg::ref_ptr<osg::MatrixTransform> _navTrans;
 	osg::ref_ptr<osg::Group> _models;
-	osg::ref_ptr<osg::Group> _boxes;
-	osg::ref_ptr<osg::Group> _launchedObjects;
+	osg::ref_ptr<osg::Group> _environment;
+	osg::ref_ptr<SpatialGridGroup> _boxes;
+	osg::ref_ptr<InstancedBoxes> _instancedBoxes;
+	osg::ref_ptr<SpatialGridGroup> _launchedObjects;
 	osg::ref_ptr<osg::MatrixTransform> _wandTrans;
 	osg::Matrixf _wandMatrix;
 	osg::Matrixf _headMatrix;
 	osg::ref_ptr<LightsGroup> _lightsGroup;
+	osg::ref_ptr<ShadowMap> _shadowMap;
 	
 	double _totalTime;
 	double _step;
 	bool _isMaster;
+	bool _useInstancedBoxes;
+	int _wallColumns;
+	int _wallRows;
+	int _wallLayers;
+	bool _occlusionCulling;
 	
 	btCollisionShape *sphereShape;
 	btDiscreteDynamicsWorld *_dynamicsWorld;
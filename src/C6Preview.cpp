@@ -0,0 +1,102 @@
+/*
+ *  C6Preview.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/27/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "C6Preview.h"
+#include "GLObjectCompiler.h"
+#include "ShadowMap.h"
+
+// Where each wall sits in the 4 x 3 layout, counted from the bottom left
+static const int WALL_COLUMNS[C6Preview::NUM_WALLS] = { 1, 0, 2, 3, 1, 1 };
+static const int WALL_ROWS[C6Preview::NUM_WALLS] = { 1, 1, 1, 1, 0, 2 };
+
+C6Preview::C6Preview(osg::GraphicsContext* context, osg::Node* scene)
+{
+	_zNear = 0.1;
+	_zFar = 5000.0;
+
+	// How far each wall's camera turns from looking straight ahead. The view
+	// matrices get the inverse, since they take the world to the camera.
+	osg::Vec3 yAxis(0.0, 1.0, 0.0), xAxis(1.0, 0.0, 0.0);
+	_wallRotations[FRONT] = osg::Matrix::identity();
+	_wallRotations[LEFT] = osg::Matrix::rotate(-osg::PI_2, yAxis);
+	_wallRotations[RIGHT] = osg::Matrix::rotate(osg::PI_2, yAxis);
+	_wallRotations[BACK] = osg::Matrix::rotate(osg::PI, yAxis);
+	_wallRotations[FLOOR] = osg::Matrix::rotate(osg::PI_2, xAxis);
+	_wallRotations[CEILING] = osg::Matrix::rotate(-osg::PI_2, xAxis);
+
+	// The cameras only clear their own corner, the context clears the gaps
+	context->setClearColor(osg::Vec4(0.0, 0.0, 0.0, 1.0));
+	context->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	_viewer = new osgViewer::CompositeViewer();
+	for (int wall = 0; wall < NUM_WALLS; wall++)
+	{
+		_views[wall] = new osgViewer::View();
+		osg::Camera* camera = _views[wall]->getCamera();
+		camera->setGraphicsContext(context);
+		camera->setClearColor(osg::Vec4(0.0, 0.0, 0.0, 1.0));
+
+		// The walls share the context, so one shadow pass a frame does for all
+		// of them. The front wall renders it and is drawn first, the others
+		// leave it out and sample the map it wrote.
+		camera->setRenderOrder(camera->getRenderOrder(), wall);
+		if (wall == FRONT)
+			camera->setCullMask(~OVERLAY_MASK);
+		else
+			camera->setCullMask(~(OVERLAY_MASK | ShadowMap::NODE_MASK));
+
+		_views[wall]->setSceneData(scene);
+		_viewer->addView(_views[wall].get());
+	}
+
+	// One camera per context is enough to drive the precompile
+	_views[FRONT]->getCamera()->setPreDrawCallback(new GLObjectCompiler::CompileCallback);
+
+	const osg::GraphicsContext::Traits* traits = context->getTraits();
+	setScreenSize(traits ? traits->width : 800, traits ? traits->height : 600);
+}
+
+osgViewer::CompositeViewer* C6Preview::getViewer()
+{
+	return _viewer.get();
+}
+
+osgViewer::View* C6Preview::getView(Wall wall)
+{
+	return _views[wall].get();
+}
+
+void C6Preview::setScreenSize(int width, int height)
+{
+	// Square walls as big as the layout allows, centered in the window
+	int size = std::min(width / 4, height / 3);
+	int left = (width - size * 4) / 2;
+	int bottom = (height - size * 3) / 2;
+
+	for (int wall = 0; wall < NUM_WALLS; wall++)
+	{
+		osg::Camera* camera = _views[wall]->getCamera();
+		camera->setViewport(left + WALL_COLUMNS[wall] * size, bottom + WALL_ROWS[wall] * size, size, size);
+		camera->setProjectionMatrixAsPerspective(90.0, 1.0, _zNear, _zFar);
+	}
+}
+
+void C6Preview::setHeadMatrix(const osg::Matrix& viewMatrix)
+{
+	for (int wall = 0; wall < NUM_WALLS; wall++)
+		_views[wall]->getCamera()->setViewMatrix(viewMatrix * _wallRotations[wall]);
+}
+
+void C6Preview::setNearFar(double zNear, double zFar)
+{
+	_zNear = zNear;
+	_zFar = zFar;
+	for (int wall = 0; wall < NUM_WALLS; wall++)
+		_views[wall]->getCamera()->setProjectionMatrixAsPerspective(90.0, 1.0, _zNear, _zFar);
+}
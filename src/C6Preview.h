@@ -0,0 +1,64 @@
+/*
+ *  C6Preview.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/27/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _C6PREVIEW_H_
+#define _C6PREVIEW_H_
+
+// All six C6 walls in one desktop window, to see what a scene costs the cave
+// before booking it. Each wall is its own osgViewer::View in a CompositeViewer,
+// laid out as an unfolded cube:
+//
+//              [ceiling]
+//      [left]  [front]  [right]  [back]
+//              [floor]
+//
+// The walls are seen from the FPS head, which stands in the middle of the cave,
+// so every wall gets a square 90 degree frustum. With the viewer running
+// CullThreadPerCameraDrawThreadPerContext each wall is culled on its own thread.
+class C6Preview : public osg::Referenced
+{
+public:
+	enum Wall
+	{
+		FRONT,
+		LEFT,
+		RIGHT,
+		BACK,
+		FLOOR,
+		CEILING,
+		NUM_WALLS
+	};
+
+	// Nodes whose mask is only this bit are left out of the walls (screen overlays)
+	static const unsigned int OVERLAY_MASK = 0x80000000;
+
+	// Constructor, the walls draw into the given window
+	C6Preview(osg::GraphicsContext* context, osg::Node* scene);
+
+	osgViewer::CompositeViewer* getViewer();
+	osgViewer::View* getView(Wall wall);
+
+	// Window size in pixels, lays the walls out again
+	void setScreenSize(int width, int height);
+
+	// View matrix of the FPS head, the walls turn from there
+	void setHeadMatrix(const osg::Matrix& viewMatrix);
+
+	void setNearFar(double zNear, double zFar);
+
+private:
+	// Private variables
+	osg::ref_ptr<osgViewer::CompositeViewer> _viewer;
+	osg::ref_ptr<osgViewer::View> _views[NUM_WALLS];
+	osg::Matrix _wallRotations[NUM_WALLS];
+	double _zNear;
+	double _zFar;
+};
+
+#endif
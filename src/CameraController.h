@@ -15,6 +15,8 @@
 #define KENTROLLERDAWTH
 
 
+class KMatrix;
+
 //first, a little vector class to help us out
 class Vec3
 {
@@ -61,25 +63,9 @@ class Vec3
 		return v;
 	}
 	
-	Vec3 unProjected()		//unproject the vector by the current GL matrices
-	{
-			//get gluUnProject ready
-		GLint viewPort[4];
-		glGetIntegerv(GL_VIEWPORT, viewPort);
-		double mod[16];
-		glGetDoublev(GL_MODELVIEW_MATRIX, mod);
-		double proj[16];
-		glGetDoublev(GL_PROJECTION_MATRIX, proj);
-
-		double wx=0;
-		double wy=0;
-		double wz=0;
-
-		gluUnProject(x, y, z, 
-			mod, proj, viewPort, &wx, &wy, &wz);
-		return Vec3(wx,wy, wz);
-
-	}
+	//unproject the vector from window coordinates with the given matrices, same as gluUnProject
+	//but without asking GL for anything, so it's safe to call from any thread
+	inline Vec3 unProjected(KMatrix& modelView, KMatrix& projection, const int viewPort[4]);
 };
 
 //tiny matrix class.
@@ -115,8 +101,85 @@ public:
 				mat.m[i*4+j] = m[j*4+i];
 		*this = mat;
 	}
+	
+	//same order as glMultMatrixf:  (*this) * b
+	KMatrix operator *(const KMatrix& b) const
+	{
+		KMatrix mat;
+		for (int col = 0; col < 4; col++)
+			for (int row = 0; row < 4; row++)
+				mat.m[col*4+row] = m[row] * b.m[col*4] + m[4+row] * b.m[col*4+1] + m[8+row] * b.m[col*4+2] + m[12+row] * b.m[col*4+3];
+		return mat;
+	}
+	
+	//CPU versions of glTranslatef and glRotatef, they multiply onto this matrix just like GL does
+	void translate(float x, float y, float z)
+	{
+		for (int row = 0; row < 4; row++)
+			m[12+row] += m[row] * x + m[4+row] * y + m[8+row] * z;
+	}
+	void rotate(float degrees, float x, float y, float z)
+	{
+		float len = sqrtf(x * x + y * y + z * z);
+		if (len == 0) return;
+		x /= len; y /= len; z /= len;
+		float c = cosf(degrees * 3.14159265f / 180.0f);
+		float s = sinf(degrees * 3.14159265f / 180.0f);
+		float t = 1 - c;
+		KMatrix r;
+		r.m[0] = t*x*x + c;		r.m[4] = t*x*y - s*z;	r.m[8] = t*x*z + s*y;
+		r.m[1] = t*x*y + s*z;	r.m[5] = t*y*y + c;		r.m[9] = t*y*z - s*x;
+		r.m[2] = t*x*z - s*y;	r.m[6] = t*y*z + s*x;	r.m[10] = t*z*z + c;
+		*this = *this * r;
+	}
+	
+	//same as gluPerspective
+	static KMatrix perspective(float fovy, float aspect, float zNear, float zFar)
+	{
+		KMatrix p;
+		float f = 1.0f / tanf(fovy * 3.14159265f / 360.0f);
+		p.m[0] = f / aspect;
+		p.m[5] = f;
+		p.m[10] = (zFar + zNear) / (zNear - zFar);
+		p.m[11] = -1;
+		p.m[14] = 2 * zFar * zNear / (zNear - zFar);
+		p.m[15] = 0;
+		return p;
+	}
+	
+	//inverse of a rotation + translation, a lot cheaper than getInverse
+	KMatrix getRigidInverse() const
+	{
+		KMatrix inv;
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				inv.m[i*4+j] = m[j*4+i];
+		for (int i = 0; i < 3; i++)
+			inv.m[12+i] = -(inv.m[i] * m[12] + inv.m[4+i] * m[13] + inv.m[8+i] * m[14]);
+		return inv;
+	}
+	
+	//transform a point, w is assumed to be 1 and the result is divided by the new w
+	Vec3 transformPoint(Vec3 p) const
+	{
+		float w = m[3] * p.x + m[7] * p.y + m[11] * p.z + m[15];
+		if (w == 0) w = 1;
+		return Vec3((m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12]) / w,
+					(m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13]) / w,
+					(m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]) / w);
+	}
 };
 
+inline Vec3 Vec3::unProjected(KMatrix& modelView, KMatrix& projection, const int viewPort[4])
+{
+	//window coordinates to normalized device coordinates, then back through the inverse of projection * modelview
+	Vec3 ndc(2.0f * (x - viewPort[0]) / viewPort[2] - 1.0f,
+			 2.0f * (y - viewPort[1]) / viewPort[3] - 1.0f,
+			 2.0f * z - 1.0f);
+	KMatrix inverse = (projection * modelView).getInverse();
+	return inverse.transformPoint(ndc);
+}
+
 class CameraController
 {
 public:
@@ -138,6 +201,16 @@ public:
 		mFPPeekY = 0;
 		mViewMode = FPS_VIEW;
 		mRightClick = false;
+		invalidate();
+	}
+	
+	//the view matrices are cached until something moves the camera.  call this if you
+	//change any of the m* members directly
+	void invalidate()
+	{
+		for (int i = 0; i < NUM_VIEW_MODES; i++)
+			mViewCacheValid[i] = false;
+		mWandCacheValid = false;
 	}
 
 	void update(float dt)
@@ -158,39 +231,39 @@ public:
 		
 		float omega = 3.0 * (mLeft - mRight);
 		mFPYaw += omega * dt;
+		invalidate();
 
 	}
 	
-	//get the modelview matrix necessary to replicate the view in question
-	KMatrix getViewMatrix(int mode = CURRENT_VIEW)		//
+	//get the modelview matrix necessary to replicate the view in question.  this is all done on the
+	//CPU and cached until the camera moves, so calling it a few times a frame costs nothing
+	KMatrix getViewMatrix(int mode = CURRENT_VIEW)
 	{
 		if (mode == CURRENT_VIEW) mode = mViewMode;
+		if (mViewCacheValid[mode])
+			return mViewCache[mode];
+		
 		KMatrix view;
-		glMatrixMode(GL_MODELVIEW);
-		glPushMatrix();
-			glLoadIdentity();
-			switch(mode)
-			{
-				case FPS_VIEW:
-					glRotatef(-mFPPeekY, 1, 0, 0);
-					glRotatef(mFPPeekX, 0, 1, 0);
-
-					glRotatef(-mFPPitch * 180.0 / 3.142, 1, 0, 0);
-					glRotatef(-mFPYaw*180.0/3.142, 0, 1, 0);
-					glTranslatef(-mFPPos.x, -mFPPos.y, -mFPPos.z);
-				break;
-				
-				case ORBIT_VIEW:
-					glTranslatef(0, 0, -30 * mOrbitZoom);
-					glRotatef(mOrbitPitch, 1, 0, 0);
-					glRotatef(mOrbitYaw, 0, 1, 0);
-				break;
+		switch(mode)
+		{
+			case FPS_VIEW:
+				view.rotate(-mFPPeekY, 1, 0, 0);
+				view.rotate(mFPPeekX, 0, 1, 0);
 
-			}
+				view.rotate(-mFPPitch * 180.0 / 3.142, 1, 0, 0);
+				view.rotate(-mFPYaw*180.0/3.142, 0, 1, 0);
+				view.translate(-mFPPos.x, -mFPPos.y, -mFPPos.z);
+			break;
 			
-			glGetFloatv(GL_MODELVIEW_MATRIX, view.m);
-			
-		glPopMatrix();
+			case ORBIT_VIEW:
+				view.translate(0, 0, -30 * mOrbitZoom);
+				view.rotate(mOrbitPitch, 1, 0, 0);
+				view.rotate(mOrbitYaw, 0, 1, 0);
+			break;
+		}
+		
+		mViewCache[mode] = view;
+		mViewCacheValid[mode] = true;
 		return view;
 	}
 	
@@ -220,6 +293,7 @@ public:
 		}
 		mLastMouseX = x;
 		mLastMouseY = y;
+		invalidate();
 	}
 	
 	
@@ -241,15 +315,16 @@ public:
 	
 	KMatrix getWandMatrix(Vec3 offset)
 	{
-//		return getViewMatrix(FPS_VIEW).m;
-		glMatrixMode(GL_MODELVIEW);
-		glPushMatrix();
-			glLoadIdentity();
-			glMultMatrixf(getViewMatrix(FPS_VIEW).getInverse().m);
-			glTranslatef(offset.x, offset.y, offset.z);			
-			KMatrix w;
-			glGetFloatv(GL_MODELVIEW_MATRIX, w.m);
-		glPopMatrix();
+		if (mWandCacheValid && offset.x == mWandCacheOffset.x && offset.y == mWandCacheOffset.y && offset.z == mWandCacheOffset.z)
+			return mWandCache;
+		
+		//the FPS view is just rotations and a translation, so the quick inverse will do
+		KMatrix w = getViewMatrix(FPS_VIEW).getRigidInverse();
+		w.translate(offset.x, offset.y, offset.z);
+		
+		mWandCache = w;
+		mWandCacheOffset = offset;
+		mWandCacheValid = true;
 		return w;
 	}
 	
@@ -263,10 +338,12 @@ public:
 	void setRight(bool r)	{mRight = r;}
 	void setStrafeLeft(bool l)	{mStrafeLeft = l;}
 	void setStrafeRight( bool r)	{mStrafeRight = r;}
+	//is the first person camera going anywhere?
+	bool isMoving()	{return mFPVelocity.length() > 0.01 || mUp || mDown || mLeft || mRight || mStrafeLeft || mStrafeRight;}
 	Vec3 getFPForward(){return Vec3(cosf(mFPPitch)*-cosf(mFPYaw - 3.14158*0.5), sinf(mFPPitch), cosf(mFPPitch)*sinf(mFPYaw - 3.14158*0.5));}
 	Vec3 getFPRight()	{return Vec3(cosf(mFPYaw), 0, -sinf(mFPYaw));}
 	Vec3 getFPUp()	{return getFPRight().cross(getFPForward());}
-	void setPeekAngles(float x, float y)	{mFPPeekX = x; mFPPeekY = y;}
+	void setPeekAngles(float x, float y)	{mFPPeekX = x; mFPPeekY = y; invalidate();}
 	float getPeekX()	{return mFPPeekX;}
 	float getPeekY()	{return mFPPeekY;}
 	float mOrbitYaw, mOrbitPitch, mOrbitZoom;
@@ -278,6 +355,12 @@ public:
 	bool mRightClick;
 	//first person controls
 	bool mUp, mDown, mLeft, mRight, mStrafeLeft, mStrafeRight;
+	//cached matrices, see invalidate()
+	KMatrix mViewCache[NUM_VIEW_MODES];
+	bool mViewCacheValid[NUM_VIEW_MODES];
+	KMatrix mWandCache;
+	Vec3 mWandCacheOffset;
+	bool mWandCacheValid;
 };
 
 
@@ -33,13 +33,13 @@ void DeviceInputController::update(double dt)
 	if (_buttons[6] == TOGGLE_ON)
 		aq::KVReflector::instance()->didUpdateValueForKey((double)-1.0, "Increase_Nav_Speed");
 	if (_buttons[7] == TOGGLE_ON)
-		printf("Empty right now\n");
+		aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Toggle_Debug_Draw");
 	if (_buttons[8] == TOGGLE_ON)
-		printf("Empty right now\n");
+		aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Toggle_Occlusion_Culling");
 	if (_buttons[9] == TOGGLE_ON)
-		printf("Empty right now\n");
+		aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Toggle_Shader_Lighting");
 	if (_buttons[10] == TOGGLE_ON)
-		printf("Empty right now\n");
+		aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Toggle_Shadows");
 		
 	// Detoggle the button (it's important that this be called every frame)
 	_deToggleButtons();
@@ -0,0 +1,450 @@
+/*
+ *  FrameRecorder.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/26/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "FrameRecorder.h"
+#include "FrameScheduler.h"
+
+// Frames that can be waiting for the encoder at once. At 1024x768 that's 3 MB each.
+static const unsigned int MAX_QUEUED_FRAMES = 8;
+
+// The buffer object entry points moved in OSG 3
+#if OPENSCENEGRAPH_MAJOR_VERSION >= 3
+typedef osg::GLBufferObject::Extensions BufferExtensions;
+static BufferExtensions* getBufferExtensions(osg::State& state)
+{
+	return osg::GLBufferObject::getExtensions(state.getContextID(), true);
+}
+#else
+typedef osg::BufferObject::Extensions BufferExtensions;
+static BufferExtensions* getBufferExtensions(osg::State& state)
+{
+	return osg::BufferObject::getExtensions(state.getContextID(), true);
+}
+#endif
+
+FrameEncoder::FrameEncoder()
+{
+	_format = RAW_VIDEO;
+	_file = NULL;
+	_numWritten = 0;
+	_numDropped = 0;
+	_width = 0;
+	_height = 0;
+	_firstTime = 0.0;
+	_lastTime = 0.0;
+	_closeRequested = false;
+	_done = false;
+
+	for (unsigned int i = 0; i < MAX_QUEUED_FRAMES; i++)
+	{
+		_frames.push_back(new Frame());
+		_free.push_back(_frames.back());
+	}
+}
+
+FrameEncoder::~FrameEncoder()
+{
+	// Write out whatever is queued, then let the thread exit
+	if (isRunning())
+	{
+		_mutex.lock();
+		_done = true;
+		_condition.broadcast();
+		_mutex.unlock();
+		join();
+	}
+	_finish();
+
+	for (unsigned int i = 0; i < _frames.size(); i++)
+		delete _frames[i];
+}
+
+void FrameEncoder::open(const std::string& prefix, Format format)
+{
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+		// The last recording has to be finished before its name is reused
+		while (_closeRequested)
+			_condition.wait(&_mutex);
+
+		_prefix = prefix;
+		_format = format;
+		_numWritten = 0;
+		_numDropped = 0;
+		_width = 0;
+		_height = 0;
+	}
+
+	if (!isRunning())
+		start();
+}
+
+void FrameEncoder::close()
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_closeRequested = true;
+	_condition.broadcast();
+}
+
+FrameEncoder::Frame* FrameEncoder::getFrame()
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	if (_free.empty())
+	{
+		_numDropped++;
+		return NULL;
+	}
+	Frame* frame = _free.back();
+	_free.pop_back();
+	return frame;
+}
+
+void FrameEncoder::write(Frame* frame)
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_queue.push_back(frame);
+	_condition.broadcast();
+}
+
+void FrameEncoder::release(Frame* frame)
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_free.push_back(frame);
+}
+
+unsigned int FrameEncoder::getNumDropped()
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	return _numDropped;
+}
+
+void FrameEncoder::run()
+{
+	while (true)
+	{
+		Frame* frame = NULL;
+		bool finish = false;
+		{
+			OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+			while (_queue.empty() && !_closeRequested && !_done)
+				_condition.wait(&_mutex);
+			if (!_queue.empty())
+			{
+				frame = _queue.front();
+				_queue.erase(_queue.begin());
+			}
+			else if (_closeRequested)
+				finish = true;
+			else
+				return;
+		}
+
+		if (frame)
+		{
+			_encode(frame);
+			release(frame);
+		}
+		else if (finish)
+		{
+			_finish();
+			OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+			_closeRequested = false;
+			_condition.broadcast();
+		}
+	}
+}
+
+void FrameEncoder::_encode(Frame* frame)
+{
+	if (_numWritten == 0)
+	{
+		_width = frame->width;
+		_height = frame->height;
+		_firstTime = frame->time;
+		_row.resize(_width * 3);
+
+		if (_format == RAW_VIDEO)
+		{
+			std::string name = _prefix + ".rgb";
+			_file = fopen(name.c_str(), "wb");
+			if (_file == NULL)
+				std::cout << "FrameEncoder: Couldn't open " << name << " for writing" << std::endl;
+		}
+	}
+
+	// Raw video has no header, every frame has to be the same size
+	if (frame->width != _width || frame->height != _height)
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+		_numDropped++;
+		return;
+	}
+
+	FILE* file = _file;
+	if (_format == IMAGE_SEQUENCE)
+	{
+		char name[1024];
+		snprintf(name, sizeof(name), "%s_%05u.ppm", _prefix.c_str(), _numWritten);
+		file = fopen(name, "wb");
+		if (file == NULL)
+		{
+			std::cout << "FrameEncoder: Couldn't open " << name << " for writing" << std::endl;
+			return;
+		}
+		fprintf(file, "P6\n%d %d\n255\n", _width, _height);
+	}
+	if (file == NULL)
+		return;
+
+	// Flip it over and swizzle BGRA to RGB a row at a time
+	for (int y = _height - 1; y >= 0; y--)
+	{
+		const unsigned char* source = &frame->pixels[y * _width * 4];
+		for (int x = 0; x < _width; x++)
+		{
+			_row[x * 3 + 0] = source[x * 4 + 2];
+			_row[x * 3 + 1] = source[x * 4 + 1];
+			_row[x * 3 + 2] = source[x * 4 + 0];
+		}
+		fwrite(&_row[0], 1, _row.size(), file);
+	}
+
+	if (_format == IMAGE_SEQUENCE)
+		fclose(file);
+
+	_lastTime = frame->time;
+	_numWritten++;
+}
+
+void FrameEncoder::_finish()
+{
+	if (_file)
+	{
+		fclose(_file);
+		_file = NULL;
+	}
+	if (_numWritten == 0)
+		return;
+
+	double frameRate = (_numWritten > 1 && _lastTime > _firstTime) ? (_numWritten - 1) / (_lastTime - _firstTime) : 30.0;
+	if (_format == RAW_VIDEO)
+	{
+		std::cout << "Recorded " << _numWritten << " frames to " << _prefix << ".rgb (" << getNumDropped() << " dropped)" << std::endl;
+		std::cout << "  Convert with: ffmpeg -f rawvideo -pix_fmt rgb24 -s " << _width << "x" << _height
+			<< " -r " << frameRate << " -i " << _prefix << ".rgb " << _prefix << ".mp4" << std::endl;
+	}
+	else
+	{
+		std::cout << "Recorded " << _numWritten << " frames to " << _prefix << "_*.ppm (" << getNumDropped() << " dropped) at "
+			<< frameRate << " fps" << std::endl;
+	}
+	_numWritten = 0;
+}
+
+FrameRecorder::FrameRecorder()
+{
+	_prefix = "capture";
+	_format = FrameEncoder::RAW_VIDEO;
+	_ringSize = 3;
+	_session = 0;
+	_next = 0;
+	_numCaptured = 0;
+	_captureTime = 0.0;
+	_width = 0;
+	_height = 0;
+	_recordingRequested = false;
+	_recording = false;
+	_captureWholeWindow = false;
+}
+
+FrameRecorder::~FrameRecorder()
+{
+	// The pixel buffers go away with the context, the encoder closes its own file
+}
+
+void FrameRecorder::setOutputPrefix(const std::string& prefix)
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_prefix = prefix;
+}
+
+void FrameRecorder::setFormat(FrameEncoder::Format format)
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_format = format;
+}
+
+void FrameRecorder::setRingSize(unsigned int size)
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_ringSize = std::max(size, 2u);
+}
+
+void FrameRecorder::setRecording(bool recording)
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_recordingRequested = recording;
+}
+
+bool FrameRecorder::isRecording()
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	return _recordingRequested;
+}
+
+void FrameRecorder::toggleRecording()
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_recordingRequested = !_recordingRequested;
+}
+
+void FrameRecorder::capture(osg::State& state, int x, int y, int width, int height)
+{
+	bool requested;
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+		requested = _recordingRequested;
+	}
+
+	// A resized window starts a new recording, raw video can't change size
+	if (_recording && (!requested || width != _width || height != _height))
+		_stop(state);
+	if (!requested || width <= 0 || height <= 0)
+		return;
+	if (!_recording)
+		_start(state, width, height);
+
+	double start = FrameScheduler::getTime();
+	BufferExtensions* extensions = getBufferExtensions(state);
+
+	// The slot we're about to reuse was read a whole ring ago, so its copy is
+	// done and mapping it won't wait on the GPU
+	unsigned int slot = _next;
+	if (_bufferPending[slot])
+		_retire(state, slot);
+
+	// Starts the copy and returns straight away, the pixels land in the buffer later
+	extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, _buffers[slot]);
+	glReadPixels(x, y, width, height, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+	extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	_bufferPending[slot] = true;
+	_bufferTimes[slot] = start;
+	_next = (slot + 1) % _buffers.size();
+
+	_captureTime += FrameScheduler::getTime() - start;
+	_numCaptured++;
+}
+
+void FrameRecorder::operator()(osg::RenderInfo& renderInfo) const
+{
+	// OSG hands draw callbacks over as const, but capturing changes the ring
+	FrameRecorder* recorder = const_cast<FrameRecorder*>(this);
+	osg::State& state = *renderInfo.getState();
+
+	const osg::GraphicsContext::Traits* traits = state.getGraphicsContext() ? state.getGraphicsContext()->getTraits() : NULL;
+	if (_captureWholeWindow && traits)
+	{
+		recorder->capture(state, 0, 0, traits->width, traits->height);
+		return;
+	}
+
+	const osg::Viewport* viewport = renderInfo.getCurrentCamera()->getViewport();
+	if (viewport)
+		recorder->capture(state, (int)viewport->x(), (int)viewport->y(), (int)viewport->width(), (int)viewport->height());
+}
+
+void FrameRecorder::setCaptureWholeWindow(bool wholeWindow)
+{
+	_captureWholeWindow = wholeWindow;
+}
+
+void FrameRecorder::_start(osg::State& state, int width, int height)
+{
+	std::string prefix;
+	FrameEncoder::Format format;
+	unsigned int ringSize;
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+		prefix = _prefix;
+		format = _format;
+		ringSize = _ringSize;
+	}
+
+	BufferExtensions* extensions = getBufferExtensions(state);
+	_buffers.resize(ringSize);
+	_bufferTimes.assign(ringSize, 0.0);
+	_bufferPending.assign(ringSize, false);
+	extensions->glGenBuffers(ringSize, &_buffers[0]);
+	for (unsigned int i = 0; i < ringSize; i++)
+	{
+		extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, _buffers[i]);
+		extensions->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, width * height * 4, NULL, GL_STREAM_READ_ARB);
+	}
+	extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+	// Every recording gets its own file
+	char name[1024];
+	snprintf(name, sizeof(name), "%s_%02u", prefix.c_str(), ++_session);
+	_encoder.open(name, format);
+
+	_width = width;
+	_height = height;
+	_next = 0;
+	_numCaptured = 0;
+	_captureTime = 0.0;
+	_recording = true;
+	std::cout << "Recording " << width << "x" << height << " to " << name << std::endl;
+}
+
+void FrameRecorder::_stop(osg::State& state)
+{
+	// Drain the ring oldest first, so the last few frames make it out too
+	for (unsigned int i = 0; i < _buffers.size(); i++)
+	{
+		unsigned int slot = (_next + i) % _buffers.size();
+		if (_bufferPending[slot])
+			_retire(state, slot);
+	}
+
+	BufferExtensions* extensions = getBufferExtensions(state);
+	extensions->glDeleteBuffers(_buffers.size(), &_buffers[0]);
+	_buffers.clear();
+	_encoder.close();
+
+	if (_numCaptured > 0)
+		std::cout << "Capture took " << _captureTime / _numCaptured * 1000.0 << " ms per frame on the draw thread" << std::endl;
+	_recording = false;
+}
+
+void FrameRecorder::_retire(osg::State& state, unsigned int slot)
+{
+	BufferExtensions* extensions = getBufferExtensions(state);
+	extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, _buffers[slot]);
+	void* pixels = extensions->glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+
+	// No spare frame means the encoder is behind, drop this one instead of waiting
+	FrameEncoder::Frame* frame = _encoder.getFrame();
+	if (pixels && frame)
+	{
+		frame->pixels.resize(_width * _height * 4);
+		memcpy(&frame->pixels[0], pixels, frame->pixels.size());
+		frame->width = _width;
+		frame->height = _height;
+		frame->time = _bufferTimes[slot];
+		_encoder.write(frame);
+	}
+	else if (frame)
+		_encoder.release(frame);
+
+	if (pixels)
+		extensions->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+	extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	_bufferPending[slot] = false;
+}
@@ -0,0 +1,140 @@
+/*
+ *  FrameRecorder.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/26/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _FRAMERECORDER_H_
+#define _FRAMERECORDER_H_
+
+// Writes captured frames to disk on its own thread, either as one raw RGB video
+// file or as a numbered sequence of PPM images. Frames come in as BGRA rows from
+// the bottom up, the way OpenGL reads them, and go out as RGB from the top down.
+class FrameEncoder : public OpenThreads::Thread
+{
+public:
+	enum Format
+	{
+		RAW_VIDEO,
+		IMAGE_SEQUENCE
+	};
+
+	struct Frame
+	{
+		std::vector<unsigned char> pixels;
+		int width;
+		int height;
+		double time;
+	};
+
+	// Constructor
+	FrameEncoder();
+	virtual ~FrameEncoder();
+
+	// Start a new recording, named prefix.rgb or prefix_00000.ppm
+	void open(const std::string& prefix, Format format);
+	void close();
+
+	// Empty frame to fill in, or NULL when every frame is still waiting to be
+	// written. Hand it back with write(), or with release() to throw it away.
+	Frame* getFrame();
+	void write(Frame* frame);
+	void release(Frame* frame);
+
+	// Frames thrown away because the encoder couldn't keep up
+	unsigned int getNumDropped();
+
+	// Encoder thread
+	virtual void run();
+
+private:
+	void _encode(Frame* frame);
+	void _finish();
+
+	// Private variables
+	std::vector<Frame*> _frames;
+	std::vector<Frame*> _free;
+	std::vector<Frame*> _queue;
+	std::vector<unsigned char> _row;
+	std::string _prefix;
+	Format _format;
+	FILE* _file;
+	unsigned int _numWritten;
+	unsigned int _numDropped;
+	int _width;
+	int _height;
+	double _firstTime;
+	double _lastTime;
+	bool _closeRequested;
+	bool _done;
+	OpenThreads::Mutex _mutex;
+	OpenThreads::Condition _condition;
+};
+
+// Records the screen without stalling the pipeline. Each frame is read into a
+// pixel buffer object, which the driver fills in the background, and only
+// mapped a few frames later when the copy is long done. The mapped pixels are
+// copied into a spare frame and handed to the encoder thread, so the draw
+// thread pays for one readback command and one memcpy per frame. If the
+// encoder falls behind, frames are dropped rather than waited for.
+//
+// Recording is toggled from any thread, but all the GL work happens in
+// capture(), on the thread that owns the context.
+class FrameRecorder : public osg::Camera::DrawCallback
+{
+public:
+	// Constructor
+	FrameRecorder();
+
+	// Output settings, used from the next recording on
+	void setOutputPrefix(const std::string& prefix);
+	void setFormat(FrameEncoder::Format format);
+
+	// Number of pixel buffers in the ring, i.e. how many frames the readback trails behind
+	void setRingSize(unsigned int size);
+
+	void setRecording(bool recording);
+	bool isRecording();
+	void toggleRecording();
+
+	// Read back the current frame. Call with the context current, after the
+	// frame is drawn and before the buffers are swapped.
+	void capture(osg::State& state, int x, int y, int width, int height);
+
+	// Final draw callback for osgViewer cameras, captures the camera's viewport
+	// or, for the last of several cameras sharing a window, the whole window
+	virtual void operator()(osg::RenderInfo& renderInfo) const;
+	void setCaptureWholeWindow(bool wholeWindow);
+
+protected:
+	virtual ~FrameRecorder();
+
+private:
+	void _start(osg::State& state, int width, int height);
+	void _stop(osg::State& state);
+	void _retire(osg::State& state, unsigned int slot);
+
+	// Private variables
+	FrameEncoder _encoder;
+	std::vector<GLuint> _buffers;
+	std::vector<double> _bufferTimes;
+	std::vector<bool> _bufferPending;
+	std::string _prefix;
+	FrameEncoder::Format _format;
+	unsigned int _ringSize;
+	unsigned int _session;
+	unsigned int _next;
+	unsigned int _numCaptured;
+	double _captureTime;
+	int _width;
+	int _height;
+	bool _recordingRequested;
+	bool _recording;
+	bool _captureWholeWindow;
+	OpenThreads::Mutex _mutex;
+};
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ *  FrameScheduler.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/23/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "FrameScheduler.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <time.h>
+#endif
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+FrameScheduler::FrameScheduler()
+{
+	_targetFrameRate = 60.0;
+	_idleFrameRate = 10.0;
+	_idleDelay = 1.0;
+	_frameStart = getTime();
+	_nextFrameTime = _frameStart;
+	_lastActivityTime = _frameStart;
+	_workTime = 0.0;
+	_excludedTime = 0.0;
+	_totalFrameTime = 0.0;
+	_totalWorkTime = 0.0;
+	_numFrames = 0;
+	_generation = 0;
+	_inFrame = false;
+	_idle = false;
+}
+
+double FrameScheduler::getTime()
+{
+#if defined(__APPLE__)
+	// mach_absolute_time ticks at a rate only the timebase knows
+	static double secondsPerTick = 0.0;
+	if (secondsPerTick == 0.0)
+	{
+		mach_timebase_info_data_t timebase;
+		mach_timebase_info(&timebase);
+		secondsPerTick = 1e-9 * timebase.numer / timebase.denom;
+	}
+	return mach_absolute_time() * secondsPerTick;
+#elif defined(WIN32)
+	static double secondsPerTick = 0.0;
+	if (secondsPerTick == 0.0)
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		secondsPerTick = 1.0 / frequency.QuadPart;
+	}
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart * secondsPerTick;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+void FrameScheduler::setTargetFrameRate(double framesPerSecond)
+{
+	_targetFrameRate = framesPerSecond;
+}
+
+double FrameScheduler::getTargetFrameRate()
+{
+	return _targetFrameRate;
+}
+
+void FrameScheduler::setIdleFrameRate(double framesPerSecond)
+{
+	_idleFrameRate = framesPerSecond;
+}
+
+double FrameScheduler::getIdleFrameRate()
+{
+	return _idleFrameRate;
+}
+
+void FrameScheduler::setIdleDelay(double seconds)
+{
+	_idleDelay = seconds;
+}
+
+void FrameScheduler::notifyActivity()
+{
+	_lastActivityTime = getTime();
+	if (_idle)
+	{
+		// Don't sit out the rest of a long idle frame
+		_idle = false;
+		_nextFrameTime = _lastActivityTime;
+		_generation++;
+	}
+}
+
+unsigned int FrameScheduler::getGeneration()
+{
+	return _generation;
+}
+
+double FrameScheduler::beginFrame(bool sceneActive)
+{
+	double now = getTime();
+	double dt = now - _frameStart;
+	_frameStart = now;
+	_inFrame = true;
+	if (_numFrames > 0)
+		_totalFrameTime += dt;
+
+	if (sceneActive)
+		_lastActivityTime = now;
+	_idle = (now - _lastActivityTime > _idleDelay);
+
+	// Schedule from the deadline rather than from now so the rate doesn't drift,
+	// unless we've fallen a whole frame behind
+	double rate = _idle ? _idleFrameRate : _targetFrameRate;
+	double period = (rate > 0.0) ? 1.0 / rate : 0.0;
+	_nextFrameTime += period;
+	if (_nextFrameTime < now)
+		_nextFrameTime = now + period;
+
+	return dt;
+}
+
+void FrameScheduler::excludeTime(double seconds)
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_excludedTimeMutex);
+	_excludedTime += seconds;
+}
+
+void FrameScheduler::endFrame()
+{
+	// Frame and work totals have to count the same frames for the summary
+	if (!_inFrame)
+		return;
+	_inFrame = false;
+
+	double excludedTime;
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_excludedTimeMutex);
+		excludedTime = _excludedTime;
+		_excludedTime = 0.0;
+	}
+
+	// A swap on a draw thread can land on either side of the frame boundary,
+	// so the difference is clamped rather than trusted to stay positive
+	_workTime = getTime() - _frameStart - excludedTime;
+	if (_workTime < 0.0)
+		_workTime = 0.0;
+	_totalWorkTime += _workTime;
+	_numFrames++;
+}
+
+double FrameScheduler::getWorkTime()
+{
+	return _workTime;
+}
+
+bool FrameScheduler::isIdle()
+{
+	return _idle;
+}
+
+unsigned int FrameScheduler::getDelay()
+{
+	double remaining = _nextFrameTime - getTime();
+	if (remaining <= 0.0)
+		return 0;
+
+	unsigned int milliseconds = (unsigned int)(remaining * 1000.0);
+	if (milliseconds == 0)
+	{
+#ifdef WIN32
+		SwitchToThread();
+#else
+		sched_yield();
+#endif
+	}
+	return milliseconds;
+}
+
+void FrameScheduler::waitForNextFrame()
+{
+	double remaining = _nextFrameTime - getTime();
+	while (remaining > 0.0)
+	{
+		// Sleep for all but the last millisecond, the OS tends to oversleep
+		if (remaining > 0.002)
+		{
+#ifdef WIN32
+			Sleep((DWORD)((remaining - 0.001) * 1000.0));
+#else
+			struct timespec sleepTime;
+			sleepTime.tv_sec = (time_t)(remaining - 0.001);
+			sleepTime.tv_nsec = (long)(((remaining - 0.001) - sleepTime.tv_sec) * 1e9);
+			nanosleep(&sleepTime, NULL);
+#endif
+		}
+		else
+		{
+#ifdef WIN32
+			SwitchToThread();
+#else
+			sched_yield();
+#endif
+		}
+		remaining = _nextFrameTime - getTime();
+	}
+}
+
+unsigned int FrameScheduler::getNumFrames()
+{
+	return _numFrames;
+}
+
+double FrameScheduler::getAverageFrameTime()
+{
+	// The first frame has nothing before it to measure from
+	return (_numFrames > 1) ? _totalFrameTime / (_numFrames - 1) : 0.0;
+}
+
+double FrameScheduler::getAverageWorkTime()
+{
+	return (_numFrames > 0) ? _totalWorkTime / _numFrames : 0.0;
+}
+
+void FrameScheduler::printSummary(const std::string& frontEnd)
+{
+	std::cout << frontEnd << ": " << _numFrames << " frames, " << getAverageFrameTime() * 1000.0 << " ms per frame, "
+		<< getAverageWorkTime() * 1000.0 << " ms working" << std::endl;
+}
@@ -0,0 +1,92 @@
+/*
+ *  FrameScheduler.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/23/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _FRAMESCHEDULER_H_
+#define _FRAMESCHEDULER_H_
+
+// Paces the desktop front ends. Frames are started on a fixed schedule at the
+// target rate, and the time in between is slept away instead of spun. When
+// nothing is going on (every body asleep and no input for a moment) the rate
+// drops to the idle rate until something happens again. All timing comes from
+// a monotonic clock with sub-microsecond resolution.
+class FrameScheduler
+{
+public:
+	// Constructor
+	FrameScheduler();
+
+	// Seconds on a monotonic clock, only differences mean anything
+	static double getTime();
+
+	// Frames per second while busy and while idle
+	void setTargetFrameRate(double framesPerSecond);
+	double getTargetFrameRate();
+	void setIdleFrameRate(double framesPerSecond);
+	double getIdleFrameRate();
+
+	// Seconds without activity before dropping to the idle rate
+	void setIdleDelay(double seconds);
+
+	// Input or anything else that should bring the rate back up right away
+	void notifyActivity();
+
+	// Goes up whenever notifyActivity moves the next frame earlier. A front end
+	// that arms a timer for the next frame tags it with the generation, and a
+	// timer that fires under an older one has been replaced and does nothing.
+	unsigned int getGeneration();
+
+	// Bracket each frame's work, both from the same callback. beginFrame returns
+	// the time since the last frame began; sceneActive keeps the scheduler out
+	// of idle. An endFrame without a beginFrame is ignored.
+	double beginFrame(bool sceneActive);
+	void endFrame();
+
+	// Time inside the frame that isn't work, like a buffer swap that blocks on
+	// the vertical retrace. Taken out of the frame's work time; safe to call
+	// from a draw thread.
+	void excludeTime(double seconds);
+
+	// Seconds the last frame spent working, without the wait before the next one
+	double getWorkTime();
+	bool isIdle();
+
+	// Milliseconds until the next frame is due, for glutTimerFunc. Anything
+	// under a millisecond is given back to the OS with a yield.
+	unsigned int getDelay();
+
+	// Sleep until the next frame is due, for front ends that own their loop
+	void waitForNextFrame();
+
+	// Averages over every frame so far, so the front ends can be compared. Run
+	// with --frame-rate 0 to see what they do unpaced.
+	unsigned int getNumFrames();
+	double getAverageFrameTime();
+	double getAverageWorkTime();
+	void printSummary(const std::string& frontEnd);
+
+private:
+	// Private variables
+	double _targetFrameRate;
+	double _idleFrameRate;
+	double _idleDelay;
+	double _frameStart;
+	double _nextFrameTime;
+	double _lastActivityTime;
+	double _workTime;
+	double _excludedTime;
+	OpenThreads::Mutex _excludedTimeMutex;
+	double _totalFrameTime;
+	double _totalWorkTime;
+	unsigned int _numFrames;
+	unsigned int _generation;
+	bool _inFrame;
+	bool _idle;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ *  GLObjectCompiler.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/18/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "GLObjectCompiler.h"
+#include <set>
+
+GLObjectCompiler::GLObjectCompiler()
+{
+	_timeBudget = 2.0;
+}
+
+void GLObjectCompiler::add(osg::Node* node)
+{
+	if (node == NULL)
+		return;
+	
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_queue.push_back(node);
+}
+
+void GLObjectCompiler::setTimeBudget(double budget)
+{
+	_timeBudget = budget;
+}
+
+double GLObjectCompiler::getTimeBudget()
+{
+	return _timeBudget;
+}
+
+// OSG 2.8's GLObjectsVisitor only compiles display lists, geometry that uses
+// vertex buffer objects instead gets its buffers on its first draw. Drawing it
+// once here with color and depth writes off uploads them without touching the
+// frame.
+class CompileVisitor : public osgUtil::GLObjectsVisitor
+{
+public:
+	CompileVisitor() : osgUtil::GLObjectsVisitor(COMPILE_DISPLAY_LISTS | COMPILE_STATE_ATTRIBUTES)
+	{
+		_noWrites = new osg::StateSet();
+		_noWrites->setAttribute(new osg::ColorMask(false, false, false, false));
+		_noWrites->setAttribute(new osg::Depth(osg::Depth::LESS, 0.0, 1.0, false));
+	}
+	
+	virtual void apply(osg::Geode& geode)
+	{
+		osgUtil::GLObjectsVisitor::apply(geode);
+		
+		osg::State* state = _renderInfo.getState();
+		for (unsigned int i = 0; i < geode.getNumDrawables(); i++)
+		{
+			osg::Drawable* drawable = geode.getDrawable(i);
+			if (state == NULL || drawable->getUseDisplayList() || !drawable->getUseVertexBufferObjects())
+				continue;
+			if (!_uploaded.insert(drawable).second)
+				continue;
+			
+			state->pushStateSet(_noWrites.get());
+			state->apply();
+			drawable->drawImplementation(_renderInfo);
+			state->popStateSet();
+			state->apply();
+		}
+	}
+	
+private:
+	osg::ref_ptr<osg::StateSet> _noWrites;
+	std::set<osg::Drawable*> _uploaded;
+};
+
+void GLObjectCompiler::compile(osg::State* state, double budget)
+{
+	unsigned int contextID = state->getContextID();
+	const osg::FrameStamp* frameStamp = state->getFrameStamp();
+	int frameNumber = frameStamp ? frameStamp->getFrameNumber() : -1;
+	std::vector< osg::ref_ptr<osg::Node> > work;
+	unsigned int numPruned = 0;
+	bool firstTime;
+	
+	// Grab this context's share of the queue and let go of the lock while compiling,
+	// the other contexts compile the same nodes at the same time from their own threads
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+		firstTime = (_contexts.find(contextID) == _contexts.end());
+		Context& context = _contexts[contextID];
+		
+		// Every viewport of a frame draws from the same budget
+		if (frameNumber < 0 || frameNumber != context.frameNumber)
+		{
+			context.frameNumber = frameNumber;
+			context.spent = 0.0;
+		}
+		budget -= context.spent;
+		
+		// A context that's new has to catch up on what the others already dropped
+		if (firstTime)
+		{
+			work = _pruned;
+			numPruned = work.size();
+		}
+		else if (budget <= 0.0)
+			return;
+		
+		if (context.position < _queue.size())
+			work.insert(work.end(), _queue.begin() + context.position, _queue.end());
+		if (work.empty())
+			return;
+	}
+	
+	osg::Timer* timer = osg::Timer::instance();
+	osg::Timer_t start = timer->tick();
+	
+	CompileVisitor visitor;
+	visitor.setState(state);
+	
+	unsigned int compiled = 0;
+	while (compiled < work.size())
+	{
+		work[compiled]->accept(visitor);
+		compiled++;
+		
+		// A brand new context has nothing on screen yet, so it does the whole backlog at once
+		if (!firstTime && timer->delta_m(start, timer->tick()) > budget)
+			break;
+	}
+	double elapsed = timer->delta_m(start, timer->tick());
+	
+	// Our copies would keep finished subgraphs from looking unused below
+	work.clear();
+	
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+		
+		// Relative to wherever the queue starts now, another context may have
+		// pruned it while we were compiling
+		Context& context = _contexts[contextID];
+		context.position += compiled - numPruned;
+		context.spent += elapsed;
+		
+		// Drop whatever every context has finished with. Whatever's still in use
+		// is kept aside for contexts that show up later.
+		unsigned int done = context.position;
+		std::map<unsigned int, Context>::iterator iter;
+		for (iter = _contexts.begin(); iter != _contexts.end(); iter++)
+			done = std::min(done, iter->second.position);
+		if (done > 64)
+		{
+			std::vector< osg::ref_ptr<osg::Node> > kept;
+			for (unsigned int i = 0; i < _pruned.size(); i++)
+				if (_pruned[i]->referenceCount() > 1)
+					kept.push_back(_pruned[i]);
+			for (unsigned int i = 0; i < done; i++)
+				if (_queue[i]->referenceCount() > 1)
+					kept.push_back(_queue[i]);
+			_pruned.swap(kept);
+			
+			_queue.erase(_queue.begin(), _queue.begin() + done);
+			for (iter = _contexts.begin(); iter != _contexts.end(); iter++)
+				iter->second.position -= done;
+		}
+	}
+	
+	if (firstTime)
+		std::cout << "Precompiled " << compiled << " subgraphs for context " << contextID << " in " 
+			<< elapsed << " ms" << std::endl;
+}
+
+void GLObjectCompiler::CompileCallback::operator()(osg::RenderInfo& renderInfo) const
+{
+	GLObjectCompiler& compiler = GLObjectCompiler::instance();
+	compiler.compile(renderInfo.getState(), compiler.getTimeBudget());
+}
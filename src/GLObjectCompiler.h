@@ -0,0 +1,68 @@
+/*
+ *  GLObjectCompiler.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/18/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _GLOBJECTCOMPILER_H_
+#define _GLOBJECTCOMPILER_H_
+
+// Compiles display lists, vertex buffer objects, textures and shader programs
+// ahead of time so new subgraphs don't stall the first frame they're drawn in.
+// Subgraphs are queued once with add(); every graphics context then works
+// through the queue on its own, from its own draw thread. Everything known when
+// a context first shows up is compiled in one go, including subgraphs the
+// other contexts finished with long ago, and anything added later is compiled a
+// little at a time within a time budget per context per frame.
+class GLObjectCompiler
+{
+protected:
+	// Constructor
+	GLObjectCompiler();
+	
+public:
+	// GLObjectCompiler is a singleton instance
+	static GLObjectCompiler& instance() { static GLObjectCompiler compiler;  return compiler; }
+	
+	// Queue a subgraph for every context, safe to call from any thread
+	void add(osg::Node* node);
+	
+	// Compile queued subgraphs for the context the state belongs to, stopping once
+	// the budget (in milliseconds) is used up. Call with the context current. A
+	// context drawing several viewports calls this once per viewport, so calls in
+	// the same frame, going by the state's frame stamp, share one budget.
+	void compile(osg::State* state, double budget);
+	
+	// Milliseconds per frame spent on runtime additions
+	void setTimeBudget(double budget);
+	double getTimeBudget();
+	
+	// Pre draw callback that drives compile() for an osgViewer camera
+	class CompileCallback : public osg::Camera::DrawCallback
+	{
+	public:
+		virtual void operator()(osg::RenderInfo& renderInfo) const;
+	};
+	
+private:
+	// How far a context got through the queue, and what it spent this frame
+	struct Context
+	{
+		Context() : position(0), frameNumber(-1), spent(0.0) {;}
+		unsigned int position;
+		int frameNumber;
+		double spent;
+	};
+	
+	// Private variables
+	std::vector< osg::ref_ptr<osg::Node> > _queue;
+	std::vector< osg::ref_ptr<osg::Node> > _pruned;
+	std::map<unsigned int, Context> _contexts;
+	OpenThreads::Mutex _mutex;
+	double _timeBudget;
+};
+
+#endif
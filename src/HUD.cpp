@@ -0,0 +1,109 @@
+/*
+ *  HUD.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/22/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "HUD.h"
+#include <stdarg.h>
+
+// Space between lines and around the edge of the window, in pixels
+static const float LINE_SPACING = 1.5f;
+static const float MARGIN = 20.0f;
+
+HUD::HUD()
+{
+	_width = 800;
+	_height = 600;
+	_characterSize = 12.0f;
+	_color = osg::Vec4(1.0f, 1.0f, 1.0f, 1.0f);
+
+	// Drawn after the main scene on top of everything. No viewport of its own,
+	// so it follows the main camera's.
+	setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+	setRenderOrder(osg::Camera::POST_RENDER);
+	setClearMask(GL_DEPTH_BUFFER_BIT);
+	setViewMatrix(osg::Matrix::identity());
+	setAllowEventFocus(false);
+
+	_geode = new osg::Geode();
+	osg::StateSet* stateSet = _geode->getOrCreateStateSet();
+	stateSet->setMode(GL_LIGHTING, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+	stateSet->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF);
+	stateSet->setAttributeAndModes(new osg::Program(), osg::StateAttribute::ON | osg::StateAttribute::PROTECTED);
+	addChild(_geode.get());
+
+	setScreenSize(_width, _height);
+}
+
+void HUD::setScreenSize(int width, int height)
+{
+	_width = width;
+	_height = height;
+	setProjectionMatrixAsOrtho2D(0, width, 0, height);
+	_layout();
+}
+
+void HUD::setLine(unsigned int line, const std::string& text)
+{
+	while (_lines.size() <= line)
+	{
+		osg::ref_ptr<osgText::Text> newLine = new osgText::Text();
+		newLine->setDataVariance(osg::Object::DYNAMIC);
+		newLine->setCharacterSize(_characterSize);
+		newLine->setColor(_color);
+		newLine->setAlignment(osgText::Text::LEFT_TOP);
+		_lines.push_back(newLine);
+		_lineText.push_back(std::string());
+		_geode->addDrawable(newLine.get());
+		_layout();
+	}
+
+	// Only rebuild the glyphs when the text actually changes
+	if (_lineText[line] != text)
+	{
+		_lineText[line] = text;
+		_lines[line]->setText(text);
+	}
+}
+
+void HUD::setLinef(unsigned int line, const char* format, ...)
+{
+	char text[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	setLine(line, text);
+}
+
+void HUD::clearLines()
+{
+	_geode->removeDrawables(0, _geode->getNumDrawables());
+	_lines.clear();
+	_lineText.clear();
+}
+
+void HUD::setCharacterSize(float size)
+{
+	_characterSize = size;
+	for (unsigned int i = 0; i < _lines.size(); i++)
+		_lines[i]->setCharacterSize(size);
+	_layout();
+}
+
+void HUD::setColor(osg::Vec4 color)
+{
+	_color = color;
+	for (unsigned int i = 0; i < _lines.size(); i++)
+		_lines[i]->setColor(color);
+}
+
+void HUD::_layout()
+{
+	for (unsigned int i = 0; i < _lines.size(); i++)
+		_lines[i]->setPosition(osg::Vec3(MARGIN, _height - MARGIN - i * _characterSize * LINE_SPACING, 0.0f));
+}
@@ -0,0 +1,48 @@
+/*
+ *  HUD.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/22/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _HUD_H_
+#define _HUD_H_
+
+// Screen space text overlay drawn by OSG after the scene. Every line is an
+// osgText::Text whose glyph geometry is built once and kept; setting a line to
+// the text it already shows does nothing, so a HUD that only changes a couple
+// of times a second costs a few cached draw calls per frame. Coordinates are in
+// window pixels with y going down from the top, like the old GLUT overlay.
+class HUD : public osg::Camera
+{
+public:
+	// Constructor
+	HUD();
+
+	// Window size in pixels, call on every reshape
+	void setScreenSize(int width, int height);
+
+	// Set a line, lines are numbered from the top and created as needed
+	void setLine(unsigned int line, const std::string& text);
+	void setLinef(unsigned int line, const char* format, ...);
+	void clearLines();
+
+	void setCharacterSize(float size);
+	void setColor(osg::Vec4 color);
+
+private:
+	void _layout();
+
+	// Private variables
+	osg::ref_ptr<osg::Geode> _geode;
+	std::vector< osg::ref_ptr<osgText::Text> > _lines;
+	std::vector<std::string> _lineText;
+	int _width;
+	int _height;
+	float _characterSize;
+	osg::Vec4 _color;
+};
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ *  InstancedBoxes.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/16/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "InstancedBoxes.h"
+#include "LightsGroup.h"
+
+// Texture unit the instance matrices are bound to
+static const int MATRIX_TEXTURE_UNIT = 1;
+
+const osg::Vec3 InstancedBoxes::WALL_CELL_SIZE(8, 8, 2);
+
+static const char* gInstancedVertexShader =
+	"#version 120\n"
+	"#extension GL_EXT_gpu_shader4 : enable\n"
+	"uniform sampler2D instanceMatrices;\n"
+	"varying vec4 color;\n"
+	"vec4 kdb_computeLighting(vec3 eyePosition, vec3 eyeNormal);\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	// Each instance is four texels wide, 256 instances to a row\n"
+	"	ivec2 texel = ivec2((gl_InstanceID % 256) * 4, gl_InstanceID / 256);\n"
+	"	mat4 instanceMatrix = mat4(texelFetch2D(instanceMatrices, texel, 0),\n"
+	"							   texelFetch2D(instanceMatrices, texel + ivec2(1, 0), 0),\n"
+	"							   texelFetch2D(instanceMatrices, texel + ivec2(2, 0), 0),\n"
+	"							   texelFetch2D(instanceMatrices, texel + ivec2(3, 0), 0));\n"
+	"\n"
+	"	vec4 eyePosition = gl_ModelViewMatrix * (instanceMatrix * gl_Vertex);\n"
+	"	vec3 normal = normalize(gl_NormalMatrix * (mat3(instanceMatrix[0].xyz, instanceMatrix[1].xyz, instanceMatrix[2].xyz) * gl_Normal));\n"
+	"\n"
+	"	// Same lights as the rest of the models, see LightsGroup\n"
+	"	color = kdb_computeLighting(eyePosition.xyz, normal);\n"
+	"	color.a = 1.0;\n"
+	"	gl_Position = gl_ProjectionMatrix * eyePosition;\n"
+	"}\n";
+
+static const char* gInstancedFragmentShader =
+	"varying vec4 color;\n"
+	"vec4 kdb_applyShadow(vec4 color);\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	gl_FragColor = kdb_applyShadow(color);\n"
+	"}\n";
+
+InstancedBoxes::InstancedBoxes(osg::Vec3 halfLengths, osg::Vec3 cellSize)
+{
+	_radius = halfLengths.length();
+	_cellSize = cellSize;
+	_occlusionCulling = false;
+
+	_createGeometry(halfLengths);
+	_createShaders();
+}
+
+InstancedBoxes::~InstancedBoxes()
+{
+	clear();
+}
+
+void InstancedBoxes::_createGeometry(osg::Vec3 halfLengths)
+{
+	// 24 vertices so every face gets its own normal
+	osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array();
+	osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array();
+	osg::ref_ptr<osg::DrawElementsUShort> triangles = new osg::DrawElementsUShort(osg::PrimitiveSet::TRIANGLES);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (int side = -1; side <= 1; side += 2)
+		{
+			osg::Vec3 normal;
+			normal[axis] = side;
+			int u = (axis + 1) % 3;
+			int v = (axis + 2) % 3;
+			unsigned short base = vertices->size();
+
+			for (int corner = 0; corner < 4; corner++)
+			{
+				osg::Vec3 vertex;
+				vertex[axis] = side * halfLengths[axis];
+				vertex[u] = ((corner == 1 || corner == 2) ? 1 : -1) * halfLengths[u];
+				vertex[v] = ((corner >= 2) ? 1 : -1) * halfLengths[v];
+				vertices->push_back(vertex);
+				normals->push_back(normal);
+			}
+
+			// Keep the winding counter-clockwise seen from outside
+			if (side > 0)
+			{
+				triangles->push_back(base);		triangles->push_back(base + 1);	triangles->push_back(base + 2);
+				triangles->push_back(base);		triangles->push_back(base + 2);	triangles->push_back(base + 3);
+			}
+			else
+			{
+				triangles->push_back(base);		triangles->push_back(base + 2);	triangles->push_back(base + 1);
+				triangles->push_back(base);		triangles->push_back(base + 3);	triangles->push_back(base + 2);
+			}
+		}
+	}
+
+	// Every cell shallow copies this, so they all share the same vertex buffers
+	_prototype = new osg::Geometry();
+	_prototype->setDataVariance(osg::Object::DYNAMIC);
+	_prototype->setVertexArray(vertices.get());
+	_prototype->setNormalArray(normals.get());
+	_prototype->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
+	_prototype->addPrimitiveSet(triangles.get());
+
+	// Instanced draws need VBOs, display lists would bake in the instance count
+	_prototype->setUseDisplayList(false);
+	_prototype->setUseVertexBufferObjects(true);
+}
+
+void InstancedBoxes::_createShaders()
+{
+	osg::ref_ptr<osg::Program> program = new osg::Program();
+	program->addShader(LightsGroup::getLightingShader());
+	program->addShader(new osg::Shader(osg::Shader::VERTEX, gInstancedVertexShader));
+	program->addShader(LightsGroup::getShadowShader());
+	program->addShader(new osg::Shader(osg::Shader::FRAGMENT, gInstancedFragmentShader));
+
+	osg::StateSet* stateSet = getOrCreateStateSet();
+	stateSet->setAttributeAndModes(program.get(), osg::StateAttribute::ON);
+	stateSet->addUniform(new osg::Uniform("instanceMatrices", MATRIX_TEXTURE_UNIT));
+}
+
+btMotionState* InstancedBoxes::addInstance(const btTransform& transform)
+{
+	Cell* cell = _getCell(transform.getOrigin());
+	unsigned int index = cell->addInstance();
+	InstanceMotionState* motionState = new InstanceMotionState(cell, index, transform);
+	_motionStates.push_back(motionState);
+	cell->setInstanceMatrix(index, transform);
+	return motionState;
+}
+
+InstancedBoxes::Cell* InstancedBoxes::_getCell(const btVector3& position)
+{
+	// Without queries a cell can never be skipped, so it would only cost a draw call
+	std::vector<int> key(3, 0);
+	if (_occlusionCulling)
+	{
+		for (int i = 0; i < 3; i++)
+			key[i] = (int)floorf(position[i] / _cellSize[i]);
+	}
+
+	osg::ref_ptr<Cell>& cell = _cells[key];
+	if (!cell.valid())
+	{
+		cell = new Cell(_prototype.get(), _radius);
+		cell->queryNode->setQueriesEnabled(_occlusionCulling);
+		addChild(cell->queryNode.get());
+	}
+	return cell.get();
+}
+
+void InstancedBoxes::_regroup()
+{
+	_cells.clear();
+	removeChildren(0, getNumChildren());
+
+	// Same motion states, the bodies keep theirs, just new slots to write into
+	for (unsigned int i = 0; i < _motionStates.size(); i++)
+	{
+		btTransform transform;
+		_motionStates[i]->getWorldTransform(transform);
+		Cell* cell = _getCell(transform.getOrigin());
+		unsigned int index = cell->addInstance();
+		_motionStates[i]->setSlot(cell, index);
+		cell->setInstanceMatrix(index, transform);
+	}
+}
+
+void InstancedBoxes::clear()
+{
+	for (unsigned int i = 0; i < _motionStates.size(); i++)
+		delete _motionStates[i];
+	_motionStates.clear();
+	_cells.clear();
+	removeChildren(0, getNumChildren());
+}
+
+unsigned int InstancedBoxes::getNumInstances()
+{
+	return _motionStates.size();
+}
+
+void InstancedBoxes::update()
+{
+	std::map< std::vector<int>, osg::ref_ptr<Cell> >::iterator iter;
+	for (iter = _cells.begin(); iter != _cells.end(); iter++)
+		iter->second->update();
+}
+
+void InstancedBoxes::setOcclusionCulling(bool enabled)
+{
+	if (enabled == _occlusionCulling)
+		return;
+
+	_occlusionCulling = enabled;
+	_regroup();
+}
+
+bool InstancedBoxes::getOcclusionCulling()
+{
+	return _occlusionCulling;
+}
+
+InstancedBoxes::Cell::Cell(osg::Geometry* prototype, float boxRadius)
+{
+	numInstances = 0;
+	radius = boxRadius;
+	dirty = false;
+
+	// Shares the prototype's arrays, but gets its own instance count and bounds
+	triangles = new osg::DrawElementsUShort(*(osg::DrawElementsUShort*)prototype->getPrimitiveSet(0), osg::CopyOp::SHALLOW_COPY);
+	geometry = new osg::Geometry(*prototype, osg::CopyOp::SHALLOW_COPY);
+	geometry->setPrimitiveSet(0, triangles.get());
+	boundsCallback = new InstanceBoundsCallback();
+	geometry->setComputeBoundingBoxCallback(boundsCallback.get());
+
+	matrixImage = new osg::Image();
+	matrixImage->setDataVariance(osg::Object::DYNAMIC);
+
+	matrixTexture = new osg::Texture2D();
+	matrixTexture->setDataVariance(osg::Object::DYNAMIC);
+	matrixTexture->setInternalFormat(GL_RGBA32F_ARB);
+	matrixTexture->setSourceFormat(GL_RGBA);
+	matrixTexture->setSourceType(GL_FLOAT);
+	matrixTexture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+	matrixTexture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+	matrixTexture->setResizeNonPowerOfTwoHint(false);
+	matrixTexture->setUnRefImageDataAfterApply(false);
+
+	geode = new osg::Geode();
+	geode->addDrawable(geometry.get());
+	geode->getOrCreateStateSet()->setTextureAttribute(MATRIX_TEXTURE_UNIT, matrixTexture.get());
+	geode->getOrCreateStateSet()->setDataVariance(osg::Object::DYNAMIC);
+
+	// Results are good for a few frames, the wall doesn't move that fast
+	queryNode = new osg::OcclusionQueryNode();
+	queryNode->setVisibilityThreshold(50);
+	queryNode->setQueryFrameCount(5);
+	queryNode->addChild(geode.get());
+
+	// Nothing to draw until the first instance shows up
+	queryNode->setNodeMask(0x0);
+}
+
+unsigned int InstancedBoxes::Cell::addInstance()
+{
+	unsigned int rows = (numInstances + INSTANCES_PER_ROW) / INSTANCES_PER_ROW;
+	if (matrixImage->data() == NULL || (unsigned int)matrixImage->t() < rows)
+	{
+		// Grow the matrix texture by doubling, keeping whatever is already in it
+		unsigned int newRows = matrixImage->data() ? matrixImage->t() * 2 : 1;
+		osg::ref_ptr<osg::Image> oldImage = new osg::Image(*matrixImage, osg::CopyOp::DEEP_COPY_ALL);
+		matrixImage->allocateImage(INSTANCES_PER_ROW * 4, newRows, 1, GL_RGBA, GL_FLOAT);
+		matrixImage->setInternalTextureFormat(GL_RGBA32F_ARB);
+		memset(matrixImage->data(), 0, matrixImage->getTotalSizeInBytes());
+		if (oldImage->data() != NULL)
+			memcpy(matrixImage->data(), oldImage->data(), oldImage->getTotalSizeInBytes());
+
+		// A new size means a new texture object rather than a subload
+		matrixTexture->setImage(matrixImage.get());
+		matrixTexture->dirtyTextureObject();
+	}
+	return numInstances++;
+}
+
+void InstancedBoxes::Cell::setInstanceMatrix(unsigned int index, const btTransform& transform)
+{
+	// btTransform's OpenGL matrix is column major, which is exactly the texel order the shader wants
+	float* matrix = (float*)matrixImage->data() + index * 16;
+	transform.getOpenGLMatrix(matrix);
+	dirty = true;
+}
+
+void InstancedBoxes::Cell::update()
+{
+	if (!dirty)
+		return;
+	dirty = false;
+
+	// Zero instances would draw one box at the origin
+	triangles->setNumInstances(numInstances);
+	queryNode->setNodeMask(numInstances ? 0xffffffff : 0x0);
+
+	// Only the box origins move, so grow the bounds by the box radius
+	osg::BoundingBox bounds;
+	const float* matrices = (const float*)matrixImage->data();
+	for (unsigned int i = 0; i < numInstances; i++)
+		bounds.expandBy(osg::Vec3(matrices[i * 16 + 12], matrices[i * 16 + 13], matrices[i * 16 + 14]));
+	if (bounds.valid())
+	{
+		bounds.xMin() -= radius;	bounds.yMin() -= radius;	bounds.zMin() -= radius;
+		bounds.xMax() += radius;	bounds.yMax() += radius;	bounds.zMax() += radius;
+	}
+	boundsCallback->bounds = bounds;
+	geometry->dirtyBound();
+
+	// One subload of the matrix texture
+	matrixImage->dirty();
+}
+
+InstancedBoxes::InstanceMotionState::InstanceMotionState(Cell* cell, unsigned int index, const btTransform& transform)
+{
+	_cell = cell;
+	_index = index;
+	_transform = transform;
+}
+
+void InstancedBoxes::InstanceMotionState::getWorldTransform(btTransform& worldTrans) const
+{
+	worldTrans = _transform;
+}
+
+void InstancedBoxes::InstanceMotionState::setWorldTransform(const btTransform& worldTrans)
+{
+	_transform = worldTrans;
+	_cell->setInstanceMatrix(_index, worldTrans);
+}
+
+void InstancedBoxes::InstanceMotionState::setSlot(Cell* cell, unsigned int index)
+{
+	_cell = cell;
+	_index = index;
+}
@@ -0,0 +1,118 @@
+/*
+ *  InstancedBoxes.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/16/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _INSTANCEDBOXES_H_
+#define _INSTANCEDBOXES_H_
+
+// Draws any number of identical boxes with instanced draw calls. There's one
+// shared box mesh, and each instance's transform is a 4x4 matrix stored in a
+// float texture that the vertex shader reads with gl_InstanceID. Bullet writes
+// straight into that texture through the motion states handed out by
+// addInstance(), so there are no per-box nodes, drawables or cull visits.
+//
+// With occlusion culling off every box is in one cell, one draw call for the
+// whole wall. With it on, boxes are regrouped into cells by where they are at
+// the time, one draw call per cell, each under an osg::OcclusionQueryNode, so
+// cells hidden behind the front of the wall are skipped. Cells whose boxes are
+// all asleep don't upload anything.
+class InstancedBoxes : public osg::Group
+{
+public:
+	// Size of the occlusion cells, also used for the wall built without instancing
+	static const osg::Vec3 WALL_CELL_SIZE;
+
+	// Constructor
+	InstancedBoxes(osg::Vec3 halfLengths, osg::Vec3 cellSize = WALL_CELL_SIZE);
+
+	// Add a box and get back the motion state for its rigid body. The box owns
+	// the motion state, it's deleted by clear() or the destructor.
+	btMotionState* addInstance(const btTransform& transform);
+	void clear();
+	unsigned int getNumInstances();
+
+	// Upload the transforms Bullet wrote during the last step. Call once per frame.
+	void update();
+
+	// Hardware occlusion queries on the cells. Results are reused for a few
+	// frames before a cell is queried again. Changing this regroups the boxes.
+	void setOcclusionCulling(bool enabled);
+	bool getOcclusionCulling();
+
+protected:
+	virtual ~InstancedBoxes();
+
+private:
+	// Bounds of a cell's boxes as they are now, the mesh alone only covers the origin
+	struct InstanceBoundsCallback : public osg::Drawable::ComputeBoundingBoxCallback
+	{
+		InstanceBoundsCallback() {;}
+		InstanceBoundsCallback(const InstanceBoundsCallback& rhs, const osg::CopyOp& copyop) :
+			osg::Drawable::ComputeBoundingBoxCallback(rhs, copyop), bounds(rhs.bounds) {;}
+		META_Object(kdb, InstanceBoundsCallback);
+		virtual osg::BoundingBox computeBound(const osg::Drawable&) const { return bounds; }
+		osg::BoundingBox bounds;
+	};
+
+	// One instanced draw call and the matrix texture that goes with it
+	class Cell : public osg::Referenced
+	{
+	public:
+		Cell(osg::Geometry* prototype, float radius);
+		void setInstanceMatrix(unsigned int index, const btTransform& transform);
+		unsigned int addInstance();
+		void update();
+
+		osg::ref_ptr<osg::OcclusionQueryNode> queryNode;
+		osg::ref_ptr<osg::Geode> geode;
+		osg::ref_ptr<osg::Geometry> geometry;
+		osg::ref_ptr<osg::DrawElementsUShort> triangles;
+		osg::ref_ptr<osg::Image> matrixImage;
+		osg::ref_ptr<osg::Texture2D> matrixTexture;
+		osg::ref_ptr<InstanceBoundsCallback> boundsCallback;
+		unsigned int numInstances;
+		float radius;
+		bool dirty;
+	};
+
+	// Motion state that writes its body's transform into one slot of a cell
+	class InstanceMotionState : public btMotionState
+	{
+	public:
+		InstanceMotionState(Cell* cell, unsigned int index, const btTransform& transform);
+		virtual void getWorldTransform(btTransform& worldTrans) const;
+		virtual void setWorldTransform(const btTransform& worldTrans);
+		void setSlot(Cell* cell, unsigned int index);
+	private:
+		Cell* _cell;
+		unsigned int _index;
+		btTransform _transform;
+	};
+
+	void _createGeometry(osg::Vec3 halfLengths);
+	void _createShaders();
+
+	// The cell a box at a position goes in, created as needed
+	Cell* _getCell(const btVector3& position);
+
+	// Put every box back into the cells the current setting calls for
+	void _regroup();
+
+	// Instances per row of a matrix texture, each one takes four RGBA texels
+	static const unsigned int INSTANCES_PER_ROW = 256;
+
+	// Private variables
+	osg::ref_ptr<osg::Geometry> _prototype;
+	std::map< std::vector<int>, osg::ref_ptr<Cell> > _cells;
+	std::vector<InstanceMotionState*> _motionStates;
+	osg::Vec3 _cellSize;
+	float _radius;
+	bool _occlusionCulling;
+};
+
+#endif
@@ -21,8 +21,21 @@ JugglerInterface::JugglerInterface(vrj::Kernel* kern, int& argc, char** argv) :
 	_timeDelta = 0.0;
 	_initialTimeIsSet = false;
 	_frameCount = 0;
+	_lastStatsReportTime = 0.0;
+	_latePreFrameTick = 0;
+	_drawEndTick = 0;
 	_navType = WAND_AND_GAMEPAD;
 	_wandIsFlying = false;
+	
+	// Frame rate the quality governor holds on the walls. It's off unless asked
+	// for, the walls are locked to the projectors' refresh rate anyway. Juggler
+	// owns the render resolution, so the governor leaves it alone.
+	QualityGovernor& governor = QualityGovernor::instance();
+	governor.setResolutionScalingEnabled(false);
+	osg::ArgumentParser arguments(&argc, argv);
+	double targetFrameRate = 0.0;
+	arguments.read("--target-fps", targetFrameRate);
+	governor.setTargetFrameRate(targetFrameRate);
 }
 
 JugglerInterface::~JugglerInterface()
@@ -78,6 +91,14 @@ void JugglerInterface::initScene()
 	_osgNavigator.init();
 }
 
+void JugglerInterface::contextInit()
+{
+	vrj::osg::App::contextInit();
+	
+	// Compile everything we know about for this context before it draws anything
+	GLObjectCompiler::instance().compile((*sceneViewer)->getState(), 0.0);
+}
+
 void JugglerInterface::preFrame()
 {
 	// Get the initial time
@@ -96,6 +117,9 @@ void JugglerInterface::preFrame()
 	if (_timeDelta > 1.0 || _timeDelta < 0.0)
 		_timeDelta = 0.0;
 	
+	// Everything left in preFrame is navigation
+	PhaseTimer::Scope navigationScope(PhaseTimer::NAVIGATION);
+	
 	//================== UPDATE WAND NAVIGATION ==================
 	if (_navType == WAND || _navType == WAND_AND_GAMEPAD)
 	{
@@ -213,7 +237,20 @@ void JugglerInterface::preFrame()
 
 void JugglerInterface::latePreFrame()
 {
+	// The last frame's work ran from its latePreFrame to the end of the slowest
+	// context's draw. Juggler swaps after that, so the vsync wait isn't counted.
+	osg::Timer_t frameStartTick = osg::Timer::instance()->tick();
+	double workTime = 0.0;
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_drawEndMutex);
+		if (_latePreFrameTick != 0 && _drawEndTick > _latePreFrameTick)
+			workTime = osg::Timer::instance()->delta_s(_latePreFrameTick, _drawEndTick);
+	}
+	_latePreFrameTick = frameStartTick;
+
 	// Pass changes in button state on to the app
+	PhaseTimer& phaseTimer = PhaseTimer::instance();
+	phaseTimer.begin(PhaseTimer::INPUT);
 	for (int i = 0; i < 10; i++)
 	{
 		if (_button[i]->getData() == gadget::Digital::TOGGLE_ON)
@@ -221,9 +258,27 @@ void JugglerInterface::latePreFrame()
 		else if (_button[i]->getData() == gadget::Digital::TOGGLE_OFF)
 			BDScene::instance().buttonInput(i + 1, false);
 	}
+	phaseTimer.end(PhaseTimer::INPUT);
 
 	// Update BDScene to time delta
 	BDScene::instance().update(_timeDelta);
+	
+	// Let the governor react to the last frame. Render resolution is Juggler's
+	// business, so only multisampling, LOD and the overlays change here.
+	QualityGovernor& governor = QualityGovernor::instance();
+	governor.frame(workTime, _timeDelta);
+	governor.applyStateSet(BDScene::instance().getRootNode()->getOrCreateStateSet());
+	BDScene::instance().setDebugDrawSuppressed(!governor.getDebugOverlay());
+	
+	// There's no stats page on the walls, so dump the physics and app phase
+	// timings every few seconds
+	if (_totalTime - _lastStatsReportTime > 5.0)
+	{
+		BDScene::instance().getPhysicsProfiler()->printReport(std::cout);
+		PhaseTimer::instance().printReport(std::cout);
+		std::cout << "Quality: " << governor.getDescription() << std::endl;
+		_lastStatsReportTime = _totalTime;
+	}
 
 	// Attach the wand's matrix to the wand
 	osg::Matrixf wandMatrix(_wand->getData().mData);
@@ -234,6 +289,8 @@ void JugglerInterface::latePreFrame()
 
 	//================== UPDATE NAVIGATION MATRIX ===============
 	
+	phaseTimer.begin(PhaseTimer::NAVIGATION);
+	
 	// Invert the osg navigator matrix
 	gmtl::Matrix44f world_transform, currentPosition;
 	currentPosition = _osgNavigator.getCurPos();
@@ -245,6 +302,8 @@ void JugglerInterface::latePreFrame()
 
 	// Actually push out the new matrix
 	BDScene::instance().setNavigationMatrix(osg_current_matrix);
+	phaseTimer.end(PhaseTimer::NAVIGATION);
+	phaseTimer.endFrame();
 	
 	// Finish updating the scene graph.
 	vrj::osg::App::latePreFrame();
@@ -282,8 +341,20 @@ void JugglerInterface::configSceneView(osgUtil::SceneView* newSceneViewer)
 
 void JugglerInterface::draw()
 {
+	// Spread the compiling of anything added at run time over a few frames
+	GLObjectCompiler::instance().compile((*sceneViewer)->getState(), GLObjectCompiler::instance().getTimeBudget());
+	
+	// Each context has its own SceneView, so the LOD bias is set per context
+	QualityGovernor::instance().applyCullSettings((*sceneViewer).get());
+	
 	vrj::osg::App::draw();
 	_frameCount++;
+
+	// Contexts draw in parallel, the frame's work ends with the last of them
+	osg::Timer_t drawEndTick = osg::Timer::instance()->tick();
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_drawEndMutex);
+	if (drawEndTick > _drawEndTick)
+		_drawEndTick = drawEndTick;
 }
 
 osg::Group* JugglerInterface::getScene()
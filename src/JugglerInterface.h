@@ -33,6 +33,8 @@
 
 #include "myType.h"
 #include "BDScene.h"
+#include "GLObjectCompiler.h"
+#include "QualityGovernor.h"
 #include "nav.h"
 
 // Cluster data object to check for the master
@@ -55,6 +57,7 @@ public:
 	// Juggler draw loop methods
     virtual void init();
     virtual void initScene();
+    virtual void contextInit();
     virtual void preFrame();
     virtual void latePreFrame();
 	virtual void draw();
@@ -97,6 +100,13 @@ public:
 	double	_timeDelta;
 	double	_previousFrameTime;
 	int		_frameCount;
+	double	_lastStatsReportTime;
+
+	// When the last latePreFrame started and the last context finished drawing,
+	// the span the quality governor counts as work
+	osg::Timer_t _latePreFrameTick;
+	osg::Timer_t _drawEndTick;
+	OpenThreads::Mutex _drawEndMutex;
 	
 	// Controls the navigation type
 	NAVIGATION_TYPE _navType;
@@ -0,0 +1,81 @@
+/*
+ *  KeyboardMapping.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/24/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifdef __APPLE__
+#  include <GLUT/glut.h>
+#else
+#  include <GL/glut.h>
+#endif
+
+#include "KeyboardMapping.h"
+#include "BDScene.h"
+#include "CameraController.h"
+
+bool KeyboardMapping::keyDown(unsigned char key, CameraController& camera)
+{
+	switch(key)
+	{
+		case '1': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Mass_1");	break;
+		case '2': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Mass_2");	break;
+		case '3': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Mass_3");	break;
+		case 'R': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Reset_Scene");	break;
+		case 'b': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Drop ball");	break;
+		case 'g': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Toggle_Debug_Draw");	break;
+		case 'o': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Toggle_Occlusion_Culling");	break;
+		case 'l': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Toggle_Shader_Lighting");	break;
+		case 'h': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Toggle_Shadows");	break;
+		case 'y': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Toggle_Aim_Preview");	break;
+			
+		case 'q': camera.setStrafeLeft(true);	break;
+		case 'w': camera.setUp(true);	break;
+		case 'e': camera.setStrafeRight(true);	break;
+		case 'a': camera.setLeft(true);	break;
+		case 's': camera.setDown(true);	break;
+		case 'd': camera.setRight(true);	break;
+		
+		case ' ':	BDScene::instance().buttonInput(0, true);	break;		//space bar controls the main wand button
+		//switch input modes with tab
+		case '\t':	camera.cycleViewMode();	break;
+			
+		default:	return false;
+	}
+	return true;
+}
+
+bool KeyboardMapping::keyUp(unsigned char key, CameraController& camera)
+{
+	switch(key)
+	{
+		case 'q': camera.setStrafeLeft(false);	break;
+		case 'w': camera.setUp(false);	break;
+		case 'e': camera.setStrafeRight(false);	break;
+		case 'a': camera.setLeft(false);	break;
+		case 's': camera.setDown(false);	break;
+		case 'd': camera.setRight(false);	break;
+			
+		case ' ':	BDScene::instance().buttonInput(0, false);	break;		//space bar controls the main wand button
+			
+		default:	return false;
+	}
+	return true;
+}
+
+bool KeyboardMapping::arrowKey(ArrowKey key)
+{
+	switch(key)
+	{
+		case ARROW_LEFT: aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Aim_Left");	break;
+		case ARROW_RIGHT: aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Aim_Right");	break;
+		case ARROW_DOWN: aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Aim_Down");	break;
+		case ARROW_UP: aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Aim_Up");	break;
+			
+		default:	return false;
+	}
+	return true;
+}
@@ -0,0 +1,35 @@
+/*
+ *  KeyboardMapping.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/24/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _KEYBOARDMAPPING_H_
+#define _KEYBOARDMAPPING_H_
+
+class CameraController;
+
+// The keys every desktop front end shares. Scene keys go out through KVO like
+// the Juggler buttons do, camera keys drive the CameraController. Keys that
+// belong to one front end (fullscreen, pause, the navigator) stay with it.
+class KeyboardMapping
+{
+public:
+	enum ArrowKey
+	{
+		ARROW_LEFT,
+		ARROW_RIGHT,
+		ARROW_UP,
+		ARROW_DOWN
+	};
+
+	// Each returns true when the key was one of ours
+	static bool keyDown(unsigned char key, CameraController& camera);
+	static bool keyUp(unsigned char key, CameraController& camera);
+	static bool arrowKey(ArrowKey key);
+};
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ *  LODGenerator.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/21/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "LODGenerator.h"
+#include <cfloat>
+
+// Counts triangles under a node so we can see what each level buys us
+class TriangleCounter : public osg::NodeVisitor
+{
+public:
+	TriangleCounter() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN), count(0) {;}
+	
+	struct Functor
+	{
+		Functor() : count(0) {;}
+		void operator()(const osg::Vec3&, const osg::Vec3&, const osg::Vec3&, bool) { count++; }
+		unsigned int count;
+	};
+	
+	virtual void apply(osg::Geode& geode)
+	{
+		for (unsigned int i = 0; i < geode.getNumDrawables(); i++)
+		{
+			osg::TriangleFunctor<Functor> functor;
+			geode.getDrawable(i)->accept(functor);
+			count += functor.count;
+		}
+	}
+	
+	unsigned int count;
+};
+
+LODGenerator::LODGenerator()
+{
+	// Distances are in scene units (meters, gravity is -9.8), a glider is about two across
+	addLevel(1.0, 25.0);
+	addLevel(0.5, 60.0);
+	addLevel(0.2, 150.0);
+	addLevel(0.05, FLT_MAX);
+}
+
+void LODGenerator::clearLevels()
+{
+	_levels.clear();
+}
+
+void LODGenerator::addLevel(float sampleRatio, float maxDistance)
+{
+	Level level;
+	level.sampleRatio = sampleRatio;
+	level.maxDistance = maxDistance;
+	_levels.push_back(level);
+}
+
+std::string LODGenerator::getSettingsKey()
+{
+	std::ostringstream settings;
+	for (unsigned int i = 0; i < _levels.size(); i++)
+		settings << _levels[i].sampleRatio << "," << _levels[i].maxDistance << ";";
+	
+	// A simple string hash keeps the file name short
+	unsigned int hash = 5381;
+	std::string text = settings.str();
+	for (unsigned int i = 0; i < text.size(); i++)
+		hash = hash * 33 + text[i];
+	
+	std::ostringstream key;
+	key << "lod" << std::hex << hash;
+	return key.str();
+}
+
+osg::ref_ptr<osg::Node> LODGenerator::generate(osg::Node* model)
+{
+	if (_levels.size() < 2)
+		return model;
+	
+	osg::ref_ptr<osg::LOD> lod = new osg::LOD();
+	lod->setName(model->getName());
+	lod->setDataVariance(osg::Object::STATIC);
+	
+	std::ostringstream report;
+	float minDistance = 0.0;
+	for (unsigned int i = 0; i < _levels.size(); i++)
+	{
+		osg::ref_ptr<osg::Node> level = model;
+		if (_levels[i].sampleRatio < 1.0)
+		{
+			// Decimate a deep copy, the original is still the most detailed level
+			level = dynamic_cast<osg::Node*>(model->clone(osg::CopyOp::DEEP_COPY_ALL));
+			osgwTools::GeometryModifier modifier(new osgwTools::DecimatorOp(_levels[i].sampleRatio));
+			level->accept(modifier);
+		}
+		
+		lod->addChild(level.get(), minDistance, _levels[i].maxDistance);
+		minDistance = _levels[i].maxDistance;
+		
+		TriangleCounter counter;
+		level->accept(counter);
+		report << (i ? " / " : "") << counter.count;
+	}
+	
+	std::cout << "LODGenerator: " << _levels.size() << " levels with " << report.str() << " triangles" << std::endl;
+	return lod.get();
+}
+
+osg::Node* LODGenerator::getHighestDetail(osg::Node* node)
+{
+	osg::LOD* lod = dynamic_cast<osg::LOD*>(node);
+	if (lod == NULL || lod->getNumChildren() == 0)
+		return node;
+	
+	// The level drawn closest to the viewer
+	unsigned int closest = 0;
+	for (unsigned int i = 1; i < lod->getNumChildren() && i < lod->getNumRanges(); i++)
+		if (lod->getMinRange(i) < lod->getMinRange(closest))
+			closest = i;
+	return lod->getChild(closest);
+}
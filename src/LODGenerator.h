@@ -0,0 +1,51 @@
+/*
+ *  LODGenerator.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/21/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _LODGENERATOR_H_
+#define _LODGENERATOR_H_
+
+// Builds an osg::LOD out of a model and decimated copies of it, using osgWorks'
+// DecimatorOp. Each level is a fraction of the original triangles and is drawn
+// out to a given distance from the viewer. ModelCache runs this at load time and
+// caches the result along with the converted model.
+class LODGenerator
+{
+public:
+	// Constructor, sets up the default chain
+	LODGenerator();
+	
+	// Replace the chain. Levels go from most to least detailed; the last
+	// level is drawn at any distance past the one before it.
+	void clearLevels();
+	void addLevel(float sampleRatio, float maxDistance);
+	
+	// Short string describing the chain, part of the cache file name so a new
+	// chain doesn't pick up old conversions
+	std::string getSettingsKey();
+	
+	// The LOD chain for a model, or the model itself if there's only one level
+	osg::ref_ptr<osg::Node> generate(osg::Node* model);
+	
+	// The most detailed level of a chain made by generate(), or the node itself
+	// if it isn't one. Anything that walks the geometry, like building a
+	// collision shape, wants this rather than every level at once.
+	static osg::Node* getHighestDetail(osg::Node* node);
+	
+private:
+	struct Level
+	{
+		float sampleRatio;
+		float maxDistance;
+	};
+	
+	// Private variables
+	std::vector<Level> _levels;
+};
+
+#endif
@@ -8,108 +8,361 @@
  */
 
 #include "LightsGroup.h"
+#include <set>
+
+// Per vertex lighting like the fixed function pipeline, but reading the lights
+// from uniform arrays so there can be more than eight of them. Light positions
+// are in navigation space and brought into eye space here, since the view
+// matrix is different for every wall and eye.
+//
+// The light that casts shadows (see ShadowMap) goes into the secondary color
+// instead, along with the shadow map coordinates, and the fragment shader adds
+// it back in wherever it isn't shadowed.
+static const char* gLightingShader =
+	"#version 120\n"
+	"const int MAX_LIGHTS = 16;\n"
+	"uniform int kdb_NumLights;\n"
+	"uniform vec4 kdb_LightPosition[MAX_LIGHTS];\n"
+	"uniform vec4 kdb_LightAmbient[MAX_LIGHTS];\n"
+	"uniform vec4 kdb_LightDiffuse[MAX_LIGHTS];\n"
+	"uniform vec4 kdb_LightSpecular[MAX_LIGHTS];\n"
+	"uniform mat4 kdb_NavigationMatrix;\n"
+	"uniform int kdb_ColorMaterial;\n"
+	"uniform bool kdb_ShadowEnabled;\n"
+	"uniform int kdb_ShadowLight;\n"
+	"uniform mat4 kdb_ShadowMatrix;\n"
+	"uniform mat4 osg_ViewMatrix;\n"
+	"uniform mat4 osg_ViewMatrixInverse;\n"
+	"\n"
+	"vec4 kdb_computeLighting(vec3 eyePosition, vec3 eyeNormal)\n"
+	"{\n"
+	"	// With color material on, the vertex color stands in for the material's,\n"
+	"	// 1 is ambient, 2 diffuse and 3 both, like glColorMaterial\n"
+	"	vec4 ambientMaterial = (kdb_ColorMaterial == 1 || kdb_ColorMaterial == 3) ? gl_Color : gl_FrontMaterial.ambient;\n"
+	"	vec4 diffuseMaterial = (kdb_ColorMaterial >= 2) ? gl_Color : gl_FrontMaterial.diffuse;\n"
+	"\n"
+	"	mat4 lightToEye = osg_ViewMatrix * kdb_NavigationMatrix;\n"
+	"	vec3 viewDir = normalize(-eyePosition);\n"
+	"	vec4 color = gl_FrontMaterial.emission + gl_LightModel.ambient * ambientMaterial;\n"
+	"	vec4 shadowed = vec4(0.0);\n"
+	"	for (int i = 0; i < kdb_NumLights; i++)\n"
+	"	{\n"
+	"		vec4 lightPosition = lightToEye * kdb_LightPosition[i];\n"
+	"		vec3 lightDir = normalize(lightPosition.xyz - eyePosition * lightPosition.w);\n"
+	"		float diffuse = max(dot(eyeNormal, lightDir), 0.0);\n"
+	"		vec4 direct = kdb_LightDiffuse[i] * diffuseMaterial * diffuse;\n"
+	"		if (diffuse > 0.0)\n"
+	"		{\n"
+	"			float specular = pow(max(dot(eyeNormal, normalize(lightDir + viewDir)), 0.0), gl_FrontMaterial.shininess);\n"
+	"			direct += kdb_LightSpecular[i] * gl_FrontMaterial.specular * specular;\n"
+	"		}\n"
+	"		color += kdb_LightAmbient[i] * ambientMaterial;\n"
+	"		if (kdb_ShadowEnabled && i == kdb_ShadowLight)\n"
+	"			shadowed += direct;\n"
+	"		else\n"
+	"			color += direct;\n"
+	"	}\n"
+	"\n"
+	"	gl_FrontSecondaryColor = shadowed;\n"
+	"	if (kdb_ShadowEnabled)\n"
+	"		gl_TexCoord[2] = kdb_ShadowMatrix * (osg_ViewMatrixInverse * vec4(eyePosition, 1.0));\n"
+	"	color.a = diffuseMaterial.a;\n"
+	"	return color;\n"
+	"}\n";
+
+static const char* gShadowShader =
+	"uniform bool kdb_ShadowEnabled;\n"
+	"uniform sampler2DShadow kdb_ShadowMap;\n"
+	"\n"
+	"vec4 kdb_applyShadow(vec4 color)\n"
+	"{\n"
+	"	if (!kdb_ShadowEnabled)\n"
+	"		return color;\n"
+	"	float lit = shadow2DProj(kdb_ShadowMap, gl_TexCoord[2]).r;\n"
+	"	return vec4(color.rgb + gl_SecondaryColor.rgb * lit, color.a);\n"
+	"}\n";
+
+// gl_NormalMatrix is the inverse transpose of the model view, so the wand's
+// scale comes out right once the result is normalized, no GL_NORMALIZE needed
+static const char* gModelsVertexShader =
+	"vec4 kdb_computeLighting(vec3 eyePosition, vec3 eyeNormal);\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	vec4 eyePosition = gl_ModelViewMatrix * gl_Vertex;\n"
+	"	vec3 eyeNormal = normalize(gl_NormalMatrix * gl_Normal);\n"
+	"	gl_FrontColor = kdb_computeLighting(eyePosition.xyz, eyeNormal);\n"
+	"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+	"	gl_Position = gl_ProjectionMatrix * eyePosition;\n"
+	"}\n";
+
+// Textures on unit 0 modulate the lit color, as GL_MODULATE would
+static const char* gModelsFragmentShader =
+	"uniform bool kdb_Texture0Enabled;\n"
+	"uniform sampler2D kdb_Texture0;\n"
+	"vec4 kdb_applyShadow(vec4 color);\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	vec4 color = kdb_applyShadow(gl_Color);\n"
+	"	if (kdb_Texture0Enabled)\n"
+	"		color *= texture2D(kdb_Texture0, gl_TexCoord[0].st);\n"
+	"	gl_FragColor = color;\n"
+	"}\n";
+
+// Finds the state the fixed function pipeline would have acted on and the
+// shaders can't see, textures on unit 0 and color material, and tells the
+// shaders through uniforms on the same state sets. Uniforms inherit like the
+// state does, so only state sets that change something get one.
+class ShaderStateVisitor : public osg::NodeVisitor
+{
+public:
+	ShaderStateVisitor() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {;}
+
+	virtual void apply(osg::Node& node)
+	{
+		_apply(node.getStateSet());
+		traverse(node);
+	}
+
+	virtual void apply(osg::Geode& geode)
+	{
+		_apply(geode.getStateSet());
+		for (unsigned int i = 0; i < geode.getNumDrawables(); i++)
+			_apply(geode.getDrawable(i)->getStateSet());
+		traverse(geode);
+	}
+
+private:
+	void _apply(osg::StateSet* stateSet)
+	{
+		if (stateSet == NULL || !_visited.insert(stateSet).second)
+			return;
+
+		// A texture counts unless its mode is switched off, and a mode set on
+		// its own switches whatever texture is inherited on or off
+		osg::StateAttribute::GLModeValue mode = stateSet->getTextureMode(0, GL_TEXTURE_2D);
+		bool modeSet = (mode & osg::StateAttribute::INHERIT) == 0;
+		bool modeOn = (mode & osg::StateAttribute::ON) != 0;
+		bool hasTexture = stateSet->getTextureAttribute(0, osg::StateAttribute::TEXTURE) != NULL;
+		if (hasTexture || modeSet)
+			stateSet->addUniform(new osg::Uniform("kdb_Texture0Enabled", modeSet ? modeOn : true));
+
+		// Specular and emission color material aren't handled, nothing here uses them
+		osg::Material* material = dynamic_cast<osg::Material*>(stateSet->getAttribute(osg::StateAttribute::MATERIAL));
+		if (material != NULL)
+		{
+			int colorMaterial = 0;
+			if (material->getColorMode() == osg::Material::AMBIENT)
+				colorMaterial = 1;
+			else if (material->getColorMode() == osg::Material::DIFFUSE)
+				colorMaterial = 2;
+			else if (material->getColorMode() == osg::Material::AMBIENT_AND_DIFFUSE)
+				colorMaterial = 3;
+			stateSet->addUniform(new osg::Uniform("kdb_ColorMaterial", colorMaterial));
+		}
+	}
+
+	std::set<osg::StateSet*> _visited;
+};
 
 LightsGroup::LightsGroup(osg::StateSet* modelsStateSet)
 {
 	_modelsStateSet = modelsStateSet;
+	_shaderLighting = false;
+	_dirty = false;
+
+	// Fixed size arrays, only the elements ever change after this
+	_numLightsUniform = new osg::Uniform("kdb_NumLights", 0);
+	_positionUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "kdb_LightPosition", MAX_LIGHTS);
+	_ambientUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "kdb_LightAmbient", MAX_LIGHTS);
+	_diffuseUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "kdb_LightDiffuse", MAX_LIGHTS);
+	_specularUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "kdb_LightSpecular", MAX_LIGHTS);
+	_navigationUniform = new osg::Uniform("kdb_NavigationMatrix", osg::Matrixf());
+
+	_numLightsUniform->setDataVariance(osg::Object::DYNAMIC);
+	_positionUniform->setDataVariance(osg::Object::DYNAMIC);
+	_ambientUniform->setDataVariance(osg::Object::DYNAMIC);
+	_diffuseUniform->setDataVariance(osg::Object::DYNAMIC);
+	_specularUniform->setDataVariance(osg::Object::DYNAMIC);
+	_navigationUniform->setDataVariance(osg::Object::DYNAMIC);
+
+	_program = new osg::Program();
+	_program->addShader(getLightingShader());
+	_program->addShader(getShadowShader());
+	_program->addShader(new osg::Shader(osg::Shader::VERTEX, gModelsVertexShader));
+	_program->addShader(new osg::Shader(osg::Shader::FRAGMENT, gModelsFragmentShader));
 }
 
 void LightsGroup::init()
 {
+	// The uniforms are always there, the instanced boxes light themselves with them
+	_modelsStateSet->addUniform(_numLightsUniform.get());
+	_modelsStateSet->addUniform(_positionUniform.get());
+	_modelsStateSet->addUniform(_ambientUniform.get());
+	_modelsStateSet->addUniform(_diffuseUniform.get());
+	_modelsStateSet->addUniform(_specularUniform.get());
+	_modelsStateSet->addUniform(_navigationUniform.get());
+
+	// Untextured and no color material unless a model's own state says otherwise
+	_modelsStateSet->addUniform(new osg::Uniform("kdb_Texture0Enabled", false));
+	_modelsStateSet->addUniform(new osg::Uniform("kdb_Texture0", 0));
+	_modelsStateSet->addUniform(new osg::Uniform("kdb_ColorMaterial", 0));
+
 	//=================== Setup Light 1 ===================
-	_light1 = new osg::Light();
-	_light1->setLightNum(0);
-	_light1->setPosition(osg::Vec4(-1.0, 1.0, -1.0, 0.0f));
-	_light1->setAmbient(osg::Vec4(0.0f, 0.0f, 0.0f, 1.0f));
-	_light1->setDiffuse(osg::Vec4(0.0f, 0.0f, 0.0f, 1.0f));
-	_light1->setSpecular(osg::Vec4(0.0f, 0.0f, 0.0f, 1.0f));
-	
-	// Create the light source
-	osg::ref_ptr<osg::LightSource> lightSource1 = new osg::LightSource();
-	lightSource1->setLight(_light1.get());
-	lightSource1->setLocalStateSetModes(osg::StateAttribute::ON);
-	lightSource1->setStateSetModes(*_modelsStateSet, osg::StateAttribute::ON);
-	
-	// Add the light source to the lights group
-	this->addChild(lightSource1.get());
-	
+	addLight(osg::Vec4(-1.0, 1.0, -1.0, 0.0f),
+			 osg::Vec4(0.0f, 0.0f, 0.0f, 1.0f),
+			 osg::Vec4(0.0f, 0.0f, 0.0f, 1.0f),
+			 osg::Vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
 	//=================== Setup Light 2 ===================
-	_light2 = new osg::Light();
-	_light2->setLightNum(1);
-	_light2->setPosition(osg::Vec4(1.0, 0.4, -1.0, 0.0f));
-	_light2->setDiffuse(osg::Vec4(0.4f, 0.4f, 0.4f, 1.0f));
-	_light2->setSpecular(osg::Vec4(0.2f, 0.2f, 0.2f, 1.0f));
-	_light2->setAmbient(osg::Vec4(0.1f, 0.1f, 0.1f, 1.0f));
-	
-	// Create the light source
-	osg::ref_ptr<osg::LightSource> lightSource2 = new osg::LightSource();
-	lightSource2->setLight(_light2.get());
-	lightSource2->setLocalStateSetModes(osg::StateAttribute::ON);
-	lightSource2->setStateSetModes(*_modelsStateSet, osg::StateAttribute::ON);	
-	
-	// Add the light source to the lights group
-	this->addChild(lightSource2.get());
-	
+	addLight(osg::Vec4(1.0, 0.4, -1.0, 0.0f),
+			 osg::Vec4(0.1f, 0.1f, 0.1f, 1.0f),
+			 osg::Vec4(0.4f, 0.4f, 0.4f, 1.0f),
+			 osg::Vec4(0.2f, 0.2f, 0.2f, 1.0f));
+
 	//=================== Setup Light 3 ===================
-	_light3 = new osg::Light();
-	_light3->setLightNum(2);
-	_light3->setPosition(osg::Vec4(-1.0, -0.4, 1.0, 0.0f));
-	_light3->setDiffuse(osg::Vec4(0.6f, 0.6f, 0.6f, 1.0f));
-	_light3->setSpecular(osg::Vec4(0.2f, 0.2f, 0.2f, 1.0f));
-	_light3->setAmbient(osg::Vec4(0.1f, 0.1f, 0.1f, 1.0f));
-	
-	// Create the light source
-	osg::ref_ptr<osg::LightSource> lightSource3 = new osg::LightSource();
-	lightSource3->setLight(_light3.get());
-	lightSource3->setLocalStateSetModes(osg::StateAttribute::ON);
-	lightSource3->setStateSetModes(*_modelsStateSet, osg::StateAttribute::ON);	
-	
-	// Add the light source to the lights group
-	this->addChild(lightSource3.get());
+	addLight(osg::Vec4(-1.0, -0.4, 1.0, 0.0f),
+			 osg::Vec4(0.1f, 0.1f, 0.1f, 1.0f),
+			 osg::Vec4(0.6f, 0.6f, 0.6f, 1.0f),
+			 osg::Vec4(0.2f, 0.2f, 0.2f, 1.0f));
+
+	_updateUniforms();
 }
 
-void LightsGroup::updateLights(float totalTime)
+int LightsGroup::addLight(osg::Vec4 position, osg::Vec4 ambient, osg::Vec4 diffuse, osg::Vec4 specular)
 {
-	return;
-	if (totalTime >= 1.0 && totalTime <= 1.5)
+	if (_lights.size() >= (unsigned int)MAX_LIGHTS)
 	{
-		float totalFadeInTime = 0.5;
-		float step = (totalTime - 1.0) / totalFadeInTime;
-
-		_light1->setAmbient(osg::Vec4(step * 0.3f, step * 0.3f, step * 0.3f, 1.0f));
-		_light1->setDiffuse(osg::Vec4(step * 1.0f, step * 1.0f, step * 1.0f, 1.0f));
-		_light1->setSpecular(osg::Vec4(step * 1.0f, step * 1.0f, step * 1.0f, 1.0f));
-		
-		_light2->setDiffuse(osg::Vec4(step * 0.4f, step * 0.4f, step * 0.4f, 1.0f));
-		_light2->setSpecular(osg::Vec4(step * 0.2f, step * 0.2f, step * 0.2f, 1.0f));
-		_light2->setAmbient(osg::Vec4(step * 0.1f, step * 0.1f, step * 0.1f, 1.0f));
-		
-		_light3->setDiffuse(osg::Vec4(step * 0.6f, step * 0.6f, step * 0.6f, 1.0f));
-		_light3->setSpecular(osg::Vec4(step * 0.2f, step * 0.2f, step * 0.2f, 1.0f));
-		_light3->setAmbient(osg::Vec4(step * 0.1f, step * 0.1f, step * 0.1f, 1.0f));
+		std::cout << "Can't add more than " << MAX_LIGHTS << " lights" << std::endl;
+		return -1;
 	}
-}
-
-
-
 
+	LightParameters light;
+	light.position = position;
+	light.ambient = ambient;
+	light.diffuse = diffuse;
+	light.specular = specular;
+	_lights.push_back(light);
+	_dirty = true;
 
+	// Fixed function GL only has eight lights
+	int index = _lights.size() - 1;
+	if (index < 8)
+	{
+		osg::ref_ptr<osg::Light> fixedLight = new osg::Light();
+		fixedLight->setLightNum(index);
+		fixedLight->setPosition(position);
+		fixedLight->setAmbient(ambient);
+		fixedLight->setDiffuse(diffuse);
+		fixedLight->setSpecular(specular);
+		_fixedLights.push_back(fixedLight);
 
+		// Create the light source
+		osg::ref_ptr<osg::LightSource> lightSource = new osg::LightSource();
+		lightSource->setLight(fixedLight.get());
+		lightSource->setLocalStateSetModes(osg::StateAttribute::ON);
+		lightSource->setStateSetModes(*_modelsStateSet, osg::StateAttribute::ON);
 
+		// Add the light source to the lights group
+		this->addChild(lightSource.get());
+	}
 
+	return index;
+}
 
+void LightsGroup::setLightColors(int index, osg::Vec4 ambient, osg::Vec4 diffuse, osg::Vec4 specular)
+{
+	_lights[index].ambient = ambient;
+	_lights[index].diffuse = diffuse;
+	_lights[index].specular = specular;
+	_dirty = true;
 
+	if (index < (int)_fixedLights.size())
+	{
+		_fixedLights[index]->setAmbient(ambient);
+		_fixedLights[index]->setDiffuse(diffuse);
+		_fixedLights[index]->setSpecular(specular);
+	}
+}
 
+void LightsGroup::setLightPosition(int index, osg::Vec4 position)
+{
+	_lights[index].position = position;
+	_dirty = true;
 
+	if (index < (int)_fixedLights.size())
+		_fixedLights[index]->setPosition(position);
+}
 
+int LightsGroup::getNumLights()
+{
+	return _lights.size();
+}
 
+void LightsGroup::setNavigationMatrix(const osg::Matrixf& matrix)
+{
+	_navigationUniform->set(matrix);
+}
 
+void LightsGroup::setShaderLightingEnabled(bool enabled)
+{
+	_shaderLighting = enabled;
+	if (enabled)
+		_modelsStateSet->setAttributeAndModes(_program.get(), osg::StateAttribute::ON);
+	else
+		_modelsStateSet->removeAttribute(_program.get());
+}
 
+bool LightsGroup::isShaderLightingEnabled()
+{
+	return _shaderLighting;
+}
 
+osg::Shader* LightsGroup::getLightingShader()
+{
+	// One copy shared by every program that links it
+	static osg::ref_ptr<osg::Shader> shader = new osg::Shader(osg::Shader::VERTEX, gLightingShader);
+	return shader.get();
+}
 
+osg::Shader* LightsGroup::getShadowShader()
+{
+	static osg::ref_ptr<osg::Shader> shader = new osg::Shader(osg::Shader::FRAGMENT, gShadowShader);
+	return shader.get();
+}
 
+void LightsGroup::prepareForShader(osg::Node* node)
+{
+	if (node == NULL)
+		return;
 
+	ShaderStateVisitor visitor;
+	node->accept(visitor);
+}
 
+osg::Vec4 LightsGroup::getLightPosition(int index)
+{
+	return _lights[index].position;
+}
 
+void LightsGroup::_updateUniforms()
+{
+	if (!_dirty)
+		return;
+	_dirty = false;
 
+	for (unsigned int i = 0; i < _lights.size(); i++)
+	{
+		_positionUniform->setElement(i, _lights[i].position);
+		_ambientUniform->setElement(i, _lights[i].ambient);
+		_diffuseUniform->setElement(i, _lights[i].diffuse);
+		_specularUniform->setElement(i, _lights[i].specular);
+	}
+	_numLightsUniform->set((int)_lights.size());
+}
 
+void LightsGroup::updateLights(float totalTime)
+{
+	_updateUniforms();
+}
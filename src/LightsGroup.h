@@ -10,22 +10,78 @@
 #ifndef _LIGHTSGROUP_H_
 #define _LIGHTSGROUP_H_
 
+// The scene's lights. Every light is kept twice: as a fixed function
+// osg::Light (only the first eight, that's all GL gives us) and as an entry in
+// a set of uniform arrays that the lighting shader reads. The uniforms are
+// created once and only their elements change, so updating a light never
+// touches the state sets.
 class LightsGroup : public osg::Group, public aq::KVObserver
 {
 public:
+	// Most lights the shader path handles
+	static const int MAX_LIGHTS = 16;
+
 	// Constructor
 	LightsGroup(osg::StateSet* modelsStateSet);
-	
+
 	// Setup and updates for all lights
 	void init();
 	void updateLights(float step);
-	
+
+	// Add a light, positions are in navigation space like the light sources.
+	// Returns the light's index, or -1 if there are already MAX_LIGHTS.
+	int addLight(osg::Vec4 position, osg::Vec4 ambient, osg::Vec4 diffuse, osg::Vec4 specular);
+	void setLightColors(int index, osg::Vec4 ambient, osg::Vec4 diffuse, osg::Vec4 specular);
+	void setLightPosition(int index, osg::Vec4 position);
+	osg::Vec4 getLightPosition(int index);
+	int getNumLights();
+
+	// The lights live under the navigation transform, the shader needs it to
+	// bring them into eye space. Call whenever navigation changes.
+	void setNavigationMatrix(const osg::Matrixf& matrix);
+
+	// Swap the fixed function lights for the lighting shader on the models
+	void setShaderLightingEnabled(bool enabled);
+	bool isShaderLightingEnabled();
+
+	// Vertex shader defining vec4 kdb_computeLighting(vec3 eyePosition, vec3 eyeNormal),
+	// for other programs that want the same lighting
+	static osg::Shader* getLightingShader();
+
+	// Fragment shader defining vec4 kdb_applyShadow(vec4 color), which adds the
+	// shadowed light back in where the shadow map says it's visible
+	static osg::Shader* getShadowShader();
+
+	// Tag a subgraph's state sets with what the models shader needs to know
+	// about them: whether texture unit 0 is on and which material colors follow
+	// the vertex color. Run this over anything added under the models.
+	static void prepareForShader(osg::Node* node);
+
 private:
+	// Push changed light parameters into the uniforms
+	void _updateUniforms();
+
+	struct LightParameters
+	{
+		osg::Vec4 position;
+		osg::Vec4 ambient;
+		osg::Vec4 diffuse;
+		osg::Vec4 specular;
+	};
+
 	// Private variables
-	osg::ref_ptr<osg::Light> _light1;
-	osg::ref_ptr<osg::Light> _light2;
-	osg::ref_ptr<osg::Light> _light3;
+	std::vector<LightParameters> _lights;
+	std::vector< osg::ref_ptr<osg::Light> > _fixedLights;
 	osg::ref_ptr<osg::StateSet> _modelsStateSet;
+	osg::ref_ptr<osg::Program> _program;
+	osg::ref_ptr<osg::Uniform> _numLightsUniform;
+	osg::ref_ptr<osg::Uniform> _positionUniform;
+	osg::ref_ptr<osg::Uniform> _ambientUniform;
+	osg::ref_ptr<osg::Uniform> _diffuseUniform;
+	osg::ref_ptr<osg::Uniform> _specularUniform;
+	osg::ref_ptr<osg::Uniform> _navigationUniform;
+	bool _shaderLighting;
+	bool _dirty;
 };
 
 #endif
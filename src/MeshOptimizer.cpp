@@ -0,0 +1,551 @@
+/*
+ *  MeshOptimizer.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/28/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "MeshOptimizer.h"
+#include <climits>
+#include <cmath>
+
+// Tuning from Forsyth's "Linear-Speed Vertex Cache Optimisation"
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+// Size of the FIFO cache the report simulates, about what the hardware has
+static const unsigned int REPORT_CACHE_SIZE = 16;
+
+// Which array of a geometry a per vertex array came from
+enum ArrayKind
+{
+	VERTEX_ARRAY,
+	NORMAL_ARRAY,
+	COLOR_ARRAY,
+	SECONDARY_COLOR_ARRAY,
+	FOG_COORD_ARRAY,
+	TEXCOORD_ARRAY,
+	VERTEX_ATTRIB_ARRAY
+};
+
+struct PerVertexArray
+{
+	osg::Array* array;
+	ArrayKind kind;
+	unsigned int unit;
+	unsigned int elementSize;
+};
+
+// Collects the triangles of any primitive set as vertex indices
+struct TriangleCollector
+{
+	std::vector<unsigned int>* indices;
+
+	void operator()(unsigned int p1, unsigned int p2, unsigned int p3)
+	{
+		if (p1 == p2 || p2 == p3 || p1 == p3)
+			return;
+		indices->push_back(p1);
+		indices->push_back(p2);
+		indices->push_back(p3);
+	}
+};
+
+// Every geometry under a node, once each even if it's shared
+class GeometryCollector : public osg::NodeVisitor
+{
+public:
+	GeometryCollector() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {;}
+
+	virtual void apply(osg::Geode& geode)
+	{
+		for (unsigned int i = 0; i < geode.getNumDrawables(); i++)
+		{
+			osg::Geometry* geometry = geode.getDrawable(i)->asGeometry();
+			if (geometry && found.insert(geometry).second)
+				geometries.push_back(geometry);
+		}
+	}
+
+	std::set<osg::Geometry*> found;
+	std::vector<osg::Geometry*> geometries;
+};
+
+template<class ArrayType>
+static osg::Array* remapArray(osg::Array* array, const std::vector<unsigned int>& order)
+{
+	ArrayType* source = dynamic_cast<ArrayType*>(array);
+	if (source == NULL)
+		return NULL;
+
+	ArrayType* result = new ArrayType(order.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		(*result)[i] = (*source)[order[i]];
+	return result;
+}
+
+// New array holding the given elements of an old one, NULL for array types we don't know
+static osg::ref_ptr<osg::Array> remap(osg::Array* array, const std::vector<unsigned int>& order)
+{
+	osg::Array* result = NULL;
+	if (!result) result = remapArray<osg::Vec3Array>(array, order);
+	if (!result) result = remapArray<osg::Vec2Array>(array, order);
+	if (!result) result = remapArray<osg::Vec4Array>(array, order);
+	if (!result) result = remapArray<osg::Vec4ubArray>(array, order);
+	if (!result) result = remapArray<osg::FloatArray>(array, order);
+	if (!result) result = remapArray<osg::Vec3dArray>(array, order);
+	return result;
+}
+
+static bool isPerVertex(osg::Geometry::AttributeBinding binding, bool& usable)
+{
+	if (binding == osg::Geometry::BIND_PER_VERTEX)
+		return true;
+	if (binding != osg::Geometry::BIND_OFF && binding != osg::Geometry::BIND_OVERALL)
+		usable = false;
+	return false;
+}
+
+static void setArray(osg::Geometry& geometry, const PerVertexArray& slot, osg::Array* array)
+{
+	switch (slot.kind)
+	{
+		case VERTEX_ARRAY:
+			geometry.setVertexArray(array);
+			break;
+		case NORMAL_ARRAY:
+			geometry.setNormalArray(array);
+			geometry.setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
+			break;
+		case COLOR_ARRAY:
+			geometry.setColorArray(array);
+			geometry.setColorBinding(osg::Geometry::BIND_PER_VERTEX);
+			break;
+		case SECONDARY_COLOR_ARRAY:
+			geometry.setSecondaryColorArray(array);
+			geometry.setSecondaryColorBinding(osg::Geometry::BIND_PER_VERTEX);
+			break;
+		case FOG_COORD_ARRAY:
+			geometry.setFogCoordArray(array);
+			geometry.setFogCoordBinding(osg::Geometry::BIND_PER_VERTEX);
+			break;
+		case TEXCOORD_ARRAY:
+			geometry.setTexCoordArray(slot.unit, array);
+			break;
+		case VERTEX_ATTRIB_ARRAY:
+			geometry.setVertexAttribArray(slot.unit, array);
+			geometry.setVertexAttribBinding(slot.unit, osg::Geometry::BIND_PER_VERTEX);
+			break;
+	}
+}
+
+static float vertexScore(int cachePosition, unsigned int remainingTriangles, unsigned int cacheSize)
+{
+	// Nothing left to draw with it
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	// The last triangle's vertices score the same whatever their order, so
+	// there's no incentive to use them again straight away
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+			score = LAST_TRIANGLE_SCORE;
+		else
+			score = powf(1.0f - (float)(cachePosition - 3) / (cacheSize - 3), CACHE_DECAY_POWER);
+	}
+
+	// Finish off vertices with few triangles left so they don't become lone stragglers
+	score += VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -VALENCE_BOOST_POWER);
+	return score;
+}
+
+MeshOptimizer::Report::Report()
+{
+	geometries = 0;
+	skipped = 0;
+	triangles = 0;
+	verticesBefore = 0;
+	verticesAfter = 0;
+	transformedBefore = 0;
+	transformedAfter = 0;
+}
+
+MeshOptimizer::MeshOptimizer()
+{
+	_stages = DEFAULT_STAGES;
+	_cacheSize = 32;
+}
+
+void MeshOptimizer::setStages(unsigned int stages)
+{
+	_stages = stages;
+}
+
+unsigned int MeshOptimizer::getStages()
+{
+	return _stages;
+}
+
+void MeshOptimizer::setCacheSize(unsigned int size)
+{
+	// The scoring needs room past the last triangle's three vertices
+	_cacheSize = std::max(size, 4u);
+}
+
+std::string MeshOptimizer::getSettingsKey()
+{
+	std::ostringstream key;
+	key << "mesh" << _stages << "c" << _cacheSize;
+	return key.str();
+}
+
+MeshOptimizer::Report MeshOptimizer::optimize(osg::Node* node, const std::string& name)
+{
+	Report report;
+	if (node == NULL || _stages == 0)
+		return report;
+
+	osg::Timer* timer = osg::Timer::instance();
+	osg::Timer_t start = timer->tick();
+
+	GeometryCollector collector;
+	node->accept(collector);
+	for (unsigned int i = 0; i < collector.geometries.size(); i++)
+	{
+		report.geometries++;
+		if ((_stages & INDEX_MESH) && !_optimizeGeometry(*collector.geometries[i], report))
+			report.skipped++;
+
+		if (_stages & VERTEX_BUFFER_OBJECTS)
+		{
+			collector.geometries[i]->setUseDisplayList(false);
+			collector.geometries[i]->setUseVertexBufferObjects(true);
+		}
+	}
+
+	std::cout << "MeshOptimizer: " << name << ": " << report.geometries << " geometries (" << report.skipped << " skipped), "
+		<< report.triangles << " triangles, " << report.verticesBefore << " -> " << report.verticesAfter << " vertices";
+	if (report.triangles > 0)
+	{
+		// Vertices transformed per triangle, 3 with no reuse and 0.5 at best
+		std::cout << ", ACMR " << (float)report.transformedBefore / report.triangles << " -> "
+			<< (float)report.transformedAfter / report.triangles;
+	}
+	std::cout << " in " << timer->delta_m(start, timer->tick()) << " ms" << std::endl;
+	return report;
+}
+
+unsigned int MeshOptimizer::countTransformedVertices(const std::vector<unsigned int>& indices, unsigned int cacheSize)
+{
+	std::vector<unsigned int> cache(cacheSize, UINT_MAX);
+	unsigned int next = 0;
+	unsigned int transformed = 0;
+	for (unsigned int i = 0; i < indices.size(); i++)
+	{
+		if (std::find(cache.begin(), cache.end(), indices[i]) != cache.end())
+			continue;
+		cache[next] = indices[i];
+		next = (next + 1) % cacheSize;
+		transformed++;
+	}
+	return transformed;
+}
+
+bool MeshOptimizer::_optimizeGeometry(osg::Geometry& geometry, Report& report)
+{
+	osg::Array* vertices = geometry.getVertexArray();
+	if (vertices == NULL || vertices->getNumElements() == 0 || geometry.getNumPrimitiveSets() == 0)
+		return false;
+	unsigned int numVertices = vertices->getNumElements();
+
+	// Arrays reached through index arrays (indexed .osg files, CAD imports)
+	// aren't in vertex order, so remapping them as if they were scrambles them
+#if OPENSCENEGRAPH_MAJOR_VERSION < 3 || (OPENSCENEGRAPH_MAJOR_VERSION == 3 && OPENSCENEGRAPH_MINOR_VERSION < 2) || defined(OSG_USE_DEPRECATED_GEOMETRY_METHODS)
+	if (geometry.suitableForOptimization())
+		return false;
+#endif
+
+	// Only triangles are optimized, lines and points are left alone
+	for (unsigned int i = 0; i < geometry.getNumPrimitiveSets(); i++)
+	{
+		GLenum mode = geometry.getPrimitiveSet(i)->getMode();
+		if (mode != GL_TRIANGLES && mode != GL_TRIANGLE_STRIP && mode != GL_TRIANGLE_FAN &&
+			mode != GL_QUADS && mode != GL_QUAD_STRIP && mode != GL_POLYGON)
+			return false;
+	}
+
+	// Everything bound per vertex gets reordered, anything bound per primitive
+	// would need splitting up and isn't worth it
+	bool usable = true;
+	std::vector<osg::Array*> arrays;
+	std::vector<PerVertexArray> slots;
+	PerVertexArray slot;
+	slot.unit = 0;
+
+	slot.array = vertices;	slot.kind = VERTEX_ARRAY;	slots.push_back(slot);
+	if (isPerVertex(geometry.getNormalBinding(), usable) && geometry.getNormalArray())
+	{
+		slot.array = geometry.getNormalArray();	slot.kind = NORMAL_ARRAY;	slots.push_back(slot);
+	}
+	if (isPerVertex(geometry.getColorBinding(), usable) && geometry.getColorArray())
+	{
+		slot.array = geometry.getColorArray();	slot.kind = COLOR_ARRAY;	slots.push_back(slot);
+	}
+	if (isPerVertex(geometry.getSecondaryColorBinding(), usable) && geometry.getSecondaryColorArray())
+	{
+		slot.array = geometry.getSecondaryColorArray();	slot.kind = SECONDARY_COLOR_ARRAY;	slots.push_back(slot);
+	}
+	if (isPerVertex(geometry.getFogCoordBinding(), usable) && geometry.getFogCoordArray())
+	{
+		slot.array = geometry.getFogCoordArray();	slot.kind = FOG_COORD_ARRAY;	slots.push_back(slot);
+	}
+	for (unsigned int unit = 0; unit < geometry.getNumTexCoordArrays(); unit++)
+	{
+		if (geometry.getTexCoordArray(unit))
+		{
+			slot.array = geometry.getTexCoordArray(unit);	slot.kind = TEXCOORD_ARRAY;	slot.unit = unit;	slots.push_back(slot);
+		}
+	}
+	for (unsigned int index = 0; index < geometry.getNumVertexAttribArrays(); index++)
+	{
+		if (isPerVertex(geometry.getVertexAttribBinding(index), usable) && geometry.getVertexAttribArray(index))
+		{
+			slot.array = geometry.getVertexAttribArray(index);	slot.kind = VERTEX_ATTRIB_ARRAY;	slot.unit = index;	slots.push_back(slot);
+		}
+	}
+	if (!usable)
+		return false;
+
+	for (unsigned int i = 0; i < slots.size(); i++)
+	{
+		if (slots[i].array->getNumElements() != numVertices)
+			return false;
+		slots[i].elementSize = slots[i].array->getTotalDataSize() / numVertices;
+	}
+
+	// Every primitive set as one list of triangles
+	std::vector<unsigned int> original;
+	osg::TriangleIndexFunctor<TriangleCollector> triangles;
+	triangles.indices = &original;
+	geometry.accept(triangles);
+	if (original.empty())
+		return false;
+
+	// Number the vertices in the order they're used, sharing a number between
+	// vertices that match in every array
+	std::vector<unsigned int> uniqueIndex(numVertices, UINT_MAX);
+	std::vector<unsigned int> representative;
+	std::map<std::string, unsigned int> uniqueVertices;
+	std::vector<unsigned int> indices;
+	indices.reserve(original.size());
+	for (unsigned int i = 0; i < original.size(); i++)
+	{
+		unsigned int vertex = original[i];
+		if (uniqueIndex[vertex] == UINT_MAX)
+		{
+			if (_stages & REMOVE_DUPLICATE_VERTICES)
+			{
+				std::string key;
+				for (unsigned int j = 0; j < slots.size(); j++)
+					key.append((const char*)slots[j].array->getDataPointer() + vertex * slots[j].elementSize, slots[j].elementSize);
+
+				std::map<std::string, unsigned int>::iterator iter = uniqueVertices.find(key);
+				if (iter != uniqueVertices.end())
+					uniqueIndex[vertex] = iter->second;
+				else
+				{
+					uniqueIndex[vertex] = representative.size();
+					uniqueVertices[key] = representative.size();
+					representative.push_back(vertex);
+				}
+			}
+			else
+			{
+				uniqueIndex[vertex] = representative.size();
+				representative.push_back(vertex);
+			}
+		}
+		indices.push_back(uniqueIndex[vertex]);
+	}
+
+	// Merging can leave triangles with two corners in the same place
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < indices.size(); i += 3)
+	{
+		if (indices[i] == indices[i + 1] || indices[i + 1] == indices[i + 2] || indices[i] == indices[i + 2])
+			continue;
+		indices[kept++] = indices[i];
+		indices[kept++] = indices[i + 1];
+		indices[kept++] = indices[i + 2];
+	}
+	indices.resize(kept);
+
+	if (_stages & VERTEX_CACHE_ORDER)
+		_orderForVertexCache(indices, representative.size());
+
+	// Lay the vertices out in the order the triangles get to them
+	std::vector<unsigned int> order = representative;
+	if (_stages & VERTEX_FETCH_ORDER)
+	{
+		std::vector<unsigned int> newIndex(representative.size(), UINT_MAX);
+		order.clear();
+		for (unsigned int i = 0; i < indices.size(); i++)
+		{
+			if (newIndex[indices[i]] == UINT_MAX)
+			{
+				newIndex[indices[i]] = order.size();
+				order.push_back(representative[indices[i]]);
+			}
+			indices[i] = newIndex[indices[i]];
+		}
+	}
+
+	// Build all the new arrays before touching the geometry, so an array type
+	// we can't copy leaves it as it was
+	std::vector< osg::ref_ptr<osg::Array> > newArrays;
+	for (unsigned int i = 0; i < slots.size(); i++)
+	{
+		newArrays.push_back(remap(slots[i].array, order));
+		if (!newArrays.back().valid())
+			return false;
+	}
+	for (unsigned int i = 0; i < slots.size(); i++)
+		setArray(geometry, slots[i], newArrays[i].get());
+
+	osg::ref_ptr<osg::DrawElements> elements;
+	if (order.size() <= USHRT_MAX)
+		elements = new osg::DrawElementsUShort(GL_TRIANGLES, indices.begin(), indices.end());
+	else
+		elements = new osg::DrawElementsUInt(GL_TRIANGLES, indices.begin(), indices.end());
+	geometry.removePrimitiveSet(0, geometry.getNumPrimitiveSets());
+	geometry.addPrimitiveSet(elements.get());
+	geometry.dirtyBound();
+	geometry.dirtyDisplayList();
+
+	report.triangles += indices.size() / 3;
+	report.verticesBefore += numVertices;
+	report.verticesAfter += order.size();
+	report.transformedBefore += countTransformedVertices(original, REPORT_CACHE_SIZE);
+	report.transformedAfter += countTransformedVertices(indices, REPORT_CACHE_SIZE);
+	return true;
+}
+
+void MeshOptimizer::_orderForVertexCache(std::vector<unsigned int>& indices, unsigned int numVertices)
+{
+	unsigned int numTriangles = indices.size() / 3;
+	if (numTriangles == 0)
+		return;
+
+	// Triangles using each vertex, packed into one array. The triangles a
+	// vertex still has to draw are kept at the front of its range.
+	std::vector<unsigned int> remaining(numVertices, 0);
+	for (unsigned int i = 0; i < indices.size(); i++)
+		remaining[indices[i]]++;
+	std::vector<unsigned int> offsets(numVertices + 1, 0);
+	for (unsigned int v = 0; v < numVertices; v++)
+		offsets[v + 1] = offsets[v] + remaining[v];
+	std::vector<unsigned int> vertexTriangles(indices.size());
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (unsigned int i = 0; i < indices.size(); i++)
+		vertexTriangles[fill[indices[i]]++] = i / 3;
+
+	std::vector<int> cachePosition(numVertices, -1);
+	std::vector<float> vertexScores(numVertices);
+	for (unsigned int v = 0; v < numVertices; v++)
+		vertexScores[v] = vertexScore(-1, remaining[v], _cacheSize);
+
+	std::vector<float> triangleScores(numTriangles);
+	std::vector<bool> drawn(numTriangles, false);
+	for (unsigned int t = 0; t < numTriangles; t++)
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	std::vector<unsigned int> cache, newCache;
+	cache.reserve(_cacheSize + 3);
+	newCache.reserve(_cacheSize + 3);
+	unsigned int firstUndrawn = 0;
+	int best = -1;
+
+	for (unsigned int n = 0; n < numTriangles; n++)
+	{
+		// Nothing in the cache leads anywhere, start again from the next
+		// triangle in the original order
+		if (best < 0)
+		{
+			while (drawn[firstUndrawn])
+				firstUndrawn++;
+			best = firstUndrawn;
+		}
+
+		const unsigned int* triangle = &indices[best * 3];
+		drawn[best] = true;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int v = triangle[k];
+			output.push_back(v);
+
+			// Move the triangle out of the vertex's live range
+			unsigned int first = offsets[v];
+			unsigned int last = first + remaining[v] - 1;
+			for (unsigned int i = first; i <= last; i++)
+			{
+				if (vertexTriangles[i] == (unsigned int)best)
+				{
+					std::swap(vertexTriangles[i], vertexTriangles[last]);
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// The triangle's vertices go to the front of the cache, everything else shuffles back
+		newCache.clear();
+		newCache.push_back(triangle[0]);
+		newCache.push_back(triangle[1]);
+		newCache.push_back(triangle[2]);
+		for (unsigned int i = 0; i < cache.size(); i++)
+			if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+				newCache.push_back(cache[i]);
+
+		// Rescore everything that moved, including whatever fell out the back
+		for (unsigned int i = 0; i < newCache.size(); i++)
+		{
+			unsigned int v = newCache[i];
+			cachePosition[v] = (i < _cacheSize) ? (int)i : -1;
+			float score = vertexScore(cachePosition[v], remaining[v], _cacheSize);
+			float change = score - vertexScores[v];
+			vertexScores[v] = score;
+			for (unsigned int j = offsets[v]; j < offsets[v] + remaining[v]; j++)
+				triangleScores[vertexTriangles[j]] += change;
+		}
+		if (newCache.size() > _cacheSize)
+			newCache.resize(_cacheSize);
+		cache.swap(newCache);
+
+		// The next triangle is the best one touching the cache
+		best = -1;
+		float bestScore = -1.0f;
+		for (unsigned int i = 0; i < cache.size(); i++)
+		{
+			unsigned int v = cache[i];
+			for (unsigned int j = offsets[v]; j < offsets[v] + remaining[v]; j++)
+			{
+				unsigned int t = vertexTriangles[j];
+				if (triangleScores[t] > bestScore)
+				{
+					bestScore = triangleScores[t];
+					best = t;
+				}
+			}
+		}
+	}
+
+	indices.swap(output);
+}
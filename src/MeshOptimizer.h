@@ -0,0 +1,78 @@
+/*
+ *  MeshOptimizer.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/28/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _MESHOPTIMIZER_H_
+#define _MESHOPTIMIZER_H_
+
+// Gets loaded geometry into the shape the vertex pipeline likes. Every
+// triangle geometry is turned into one indexed triangle list with duplicate
+// vertices merged, the triangles are put in vertex cache order (Tom Forsyth's
+// linear-speed algorithm), the vertices are put in the order the triangles
+// first use them, and the result is drawn from vertex buffer objects.
+// ModelCache runs this at load time and caches the result along with the
+// converted model. OSG 2.8 only precompiles display lists, so the buffers are
+// uploaded ahead of time by GLObjectCompiler instead.
+//
+// Geometry that isn't all triangles, that binds anything per primitive, or
+// that uses OSG 2.8's per-array index arrays is left as it is.
+class MeshOptimizer
+{
+public:
+	enum Stages
+	{
+		INDEX_MESH = 1,					// one indexed triangle list per geometry
+		REMOVE_DUPLICATE_VERTICES = 2,	// share vertices that match in every array
+		VERTEX_CACHE_ORDER = 4,			// reorder triangles for the post-transform cache
+		VERTEX_FETCH_ORDER = 8,			// reorder vertices to match the triangles
+		VERTEX_BUFFER_OBJECTS = 16,		// draw from VBOs instead of display lists
+		DEFAULT_STAGES = INDEX_MESH | REMOVE_DUPLICATE_VERTICES | VERTEX_CACHE_ORDER | VERTEX_FETCH_ORDER | VERTEX_BUFFER_OBJECTS
+	};
+
+	// Vertex counts and cache behavior of a model before and after
+	struct Report
+	{
+		Report();
+		unsigned int geometries;
+		unsigned int skipped;
+		unsigned int triangles;
+		unsigned int verticesBefore;
+		unsigned int verticesAfter;
+		unsigned int transformedBefore;
+		unsigned int transformedAfter;
+	};
+
+	// Constructor, runs every stage
+	MeshOptimizer();
+
+	void setStages(unsigned int stages);
+	unsigned int getStages();
+
+	// Cache size the triangle order is tuned for
+	void setCacheSize(unsigned int size);
+
+	// Short string describing the settings, part of the cache file name
+	std::string getSettingsKey();
+
+	// Optimize every geometry under a node in place and print the report
+	Report optimize(osg::Node* node, const std::string& name);
+
+	// Vertices a FIFO post-transform cache of the given size would transform
+	// drawing these triangles, divided by the triangle count this is the ACMR
+	static unsigned int countTransformedVertices(const std::vector<unsigned int>& indices, unsigned int cacheSize);
+
+private:
+	bool _optimizeGeometry(osg::Geometry& geometry, Report& report);
+	void _orderForVertexCache(std::vector<unsigned int>& indices, unsigned int numVertices);
+
+	// Private variables
+	unsigned int _stages;
+	unsigned int _cacheSize;
+};
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ *  ModelCache.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/17/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "ModelCache.h"
+#include "BDScene.h"
+#include "GLObjectCompiler.h"
+#include <sys/stat.h>
+#include <cstdlib>
+#include <cstdio>
+
+ModelCache::ModelCache()
+{
+	_done = false;
+	_optimizeOnConvert = true;
+	
+	const char* directory = getenv("KDB_MODEL_CACHE");
+	_cacheDirectory = directory ? directory : "ModelCache";
+}
+
+ModelCache::~ModelCache()
+{
+	// Let the loader thread finish what it's doing and exit
+	if (isRunning())
+	{
+		_mutex.lock();
+		_done = true;
+		_condition.broadcast();
+		_mutex.unlock();
+		join();
+	}
+}
+
+void ModelCache::preload(std::string name)
+{
+	// Resolving the name hits the disk, so it happens here at startup and never again
+	std::string path = BDScene::findDataFile(name);
+	if (path.empty())
+		return;
+	
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+		_resolvedPaths[name] = path;
+		if (_entries.find(path) != _entries.end())
+			return;
+		_entries[path] = Entry();
+		_queue.push_back(path);
+		_condition.broadcast();
+	}
+	
+	if (!isRunning())
+		start();
+}
+
+osg::Node* ModelCache::getModel(std::string name)
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	
+	std::map<std::string, std::string>::iterator pathIter = _resolvedPaths.find(name);
+	if (pathIter == _resolvedPaths.end())
+	{
+		std::cout << "ModelCache: " << name << " was never preloaded" << std::endl;
+		return NULL;
+	}
+	
+	// Still loading, this only happens if someone asks right after startup
+	std::map<std::string, Entry>::iterator entryIter = _entries.find(pathIter->second);
+	while (!entryIter->second.loaded)
+		_condition.wait(&_mutex);
+	
+	return entryIter->second.node.get();
+}
+
+void ModelCache::waitForPreload()
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	while (!_queue.empty())
+		_condition.wait(&_mutex);
+	
+	// The queue empties before the last model is stored, so wait for that too
+	std::map<std::string, Entry>::iterator iter;
+	for (iter = _entries.begin(); iter != _entries.end(); iter++)
+		while (!iter->second.loaded)
+			_condition.wait(&_mutex);
+}
+
+void ModelCache::setCacheDirectory(std::string directory)
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_cacheDirectory = directory;
+}
+
+void ModelCache::setOptimizeOnConvert(bool optimize)
+{
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	_optimizeOnConvert = optimize;
+}
+
+LODGenerator& ModelCache::getLODGenerator()
+{
+	return _lodGenerator;
+}
+
+MeshOptimizer& ModelCache::getMeshOptimizer()
+{
+	return _meshOptimizer;
+}
+
+void ModelCache::run()
+{
+	while (true)
+	{
+		std::string path;
+		{
+			OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+			while (_queue.empty() && !_done)
+				_condition.wait(&_mutex);
+			if (_done)
+				return;
+			path = _queue.front();
+			_queue.erase(_queue.begin());
+		}
+		
+		osg::ref_ptr<osg::Node> node = _load(path);
+		
+		// Nobody else has it yet, so the state sets can still be tagged here
+		LightsGroup::prepareForShader(node.get());
+		
+		// Get it onto the GPU before anyone launches one
+		GLObjectCompiler::instance().add(node.get());
+		
+		{
+			OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+			_entries[path].node = node;
+			_entries[path].loaded = true;
+			_condition.broadcast();
+		}
+	}
+}
+
+osg::ref_ptr<osg::Node> ModelCache::_load(const std::string& path)
+{
+	osg::Timer* timer = osg::Timer::instance();
+	std::string cachePath = _cachePath(path);
+	
+	// Use the converted copy if there is one for this version of the source
+	if (!cachePath.empty() && osgDB::fileExists(cachePath))
+	{
+		osg::Timer_t start = timer->tick();
+		osg::ref_ptr<osg::Node> node = osgDB::readNodeFile(cachePath);
+		if (node.valid())
+		{
+			node->setDataVariance(osg::Object::STATIC);
+			std::cout << "ModelCache: loaded " << path << " from " << cachePath << " in " 
+				<< timer->delta_m(start, timer->tick()) << " ms" << std::endl;
+			return node;
+		}
+		std::cout << "ModelCache: " << cachePath << " is unreadable, converting again" << std::endl;
+	}
+	
+	osg::Timer_t start = timer->tick();
+	osg::ref_ptr<osg::Node> node = osgDB::readNodeFile(path);
+	osg::Timer_t sourceEnd = timer->tick();
+	if (!node.valid())
+	{
+		std::cout << "ModelCache: problem loading " << path << std::endl;
+		return NULL;
+	}
+	
+	// Everyone shares this copy, nobody should be changing it
+	node->setDataVariance(osg::Object::STATIC);
+	
+	bool optimize;
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+		optimize = _optimizeOnConvert;
+	}
+	if (optimize)
+	{
+		osgUtil::Optimizer optimizer;
+		optimizer.optimize(node.get());
+	}
+	
+	// Distant copies don't need all the triangles
+	node = _lodGenerator.generate(node.get());
+	
+	// Index, reorder and VBO every level, the decimated ones included
+	_meshOptimizer.optimize(node.get(), osgDB::getSimpleFileName(path));
+	
+	if (!cachePath.empty())
+	{
+		osgDB::makeDirectoryForFile(cachePath);
+		if (osgDB::writeNodeFile(*node, cachePath))
+			_removeStaleCacheFiles(path, cachePath);
+		else
+			std::cout << "ModelCache: couldn't write " << cachePath << std::endl;
+	}
+	
+	// Parsing the source is what the cache saves on later runs, compare it with
+	// the cached load time printed above on the next run
+	std::cout << "ModelCache: loaded " << path << " in " << timer->delta_m(start, sourceEnd) << " ms, converted in "
+		<< timer->delta_m(sourceEnd, timer->tick()) << " ms" << std::endl;
+	
+	return node;
+}
+
+std::string ModelCache::_cachePath(const std::string& path)
+{
+	std::string directory;
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+		directory = _cacheDirectory;
+	}
+	if (directory.empty())
+		return "";
+	
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return "";
+	
+	std::ostringstream cachePath;
+	cachePath << directory << "/" << _cacheName(path) << "." << (long)info.st_mtime << "-" << _lodGenerator.getSettingsKey() << "-" << _meshOptimizer.getSettingsKey() << ".ive";
+	return cachePath.str();
+}
+
+std::string ModelCache::_cacheName(const std::string& path)
+{
+	// Flatten the full source path into a file name
+	std::string name = path;
+	for (unsigned int i = 0; i < name.size(); i++)
+		if (name[i] == '/' || name[i] == '\\' || name[i] == ':' || name[i] == ' ')
+			name[i] = '_';
+	return name;
+}
+
+void ModelCache::_removeStaleCacheFiles(const std::string& path, const std::string& current)
+{
+	// Conversions of older versions of the same source are no use to anyone.
+	// Only names that are exactly <source name>.<mtime>-<settings>.ive match,
+	// so x.osg never takes x.osg.bak's conversions with it.
+	std::string directory = osgDB::getFilePath(current);
+	std::string currentName = osgDB::getSimpleFileName(current);
+	std::string prefix = _cacheName(path) + ".";
+	
+	osgDB::DirectoryContents contents = osgDB::getDirectoryContents(directory);
+	for (unsigned int i = 0; i < contents.size(); i++)
+	{
+		const std::string& name = contents[i];
+		if (name == currentName || name.size() <= prefix.size() + 4 || name.compare(0, prefix.size(), prefix) != 0)
+			continue;
+		if (name.compare(name.size() - 4, 4, ".ive") != 0)
+			continue;
+		
+		// An mtime, then the settings, with no more dots before the extension
+		std::string rest = name.substr(prefix.size(), name.size() - prefix.size() - 4);
+		std::string::size_type digits = rest.find_first_not_of("0123456789");
+		if (digits == 0 || digits == std::string::npos || rest[digits] != '-' || rest.find('.') != std::string::npos)
+			continue;
+		
+		remove((directory + "/" + name).c_str());
+	}
+}
@@ -0,0 +1,93 @@
+/*
+ *  ModelCache.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/17/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _MODELCACHE_H_
+#define _MODELCACHE_H_
+
+#include "LODGenerator.h"
+#include "MeshOptimizer.h"
+
+// Loads models once, on a background thread, and hands the same scene graph out
+// to everyone who asks for it. Models are keyed by the path BDScene::findDataFile
+// resolves them to, so two names for the same file share one copy. Anything
+// needed during the demo should be preloaded at startup; getModel() never reads
+// from disk on the calling thread.
+//
+// The first time a model is loaded it's also written out in OSG's native binary
+// format (.ive) to a cache directory, named after the source path and its
+// modification time. Later runs read that instead of parsing the source again.
+// Models are turned into LOD chains before they're written, so the decimated
+// levels are cached too, and every level goes through the MeshOptimizer.
+class ModelCache : public OpenThreads::Thread
+{
+protected:
+	// Constructor
+	ModelCache();
+	virtual ~ModelCache();
+	
+public:
+	// ModelCache is a singleton instance
+	static ModelCache& instance() { static ModelCache cache;  return cache; }
+	
+	// Queue a model for the loader thread, starting it if needed
+	void preload(std::string name);
+	
+	// Shared copy of a model. Waits if the model is still loading, and returns
+	// NULL if it was never preloaded or failed to load.
+	osg::Node* getModel(std::string name);
+	
+	// Block until everything queued so far has been loaded
+	void waitForPreload();
+	
+	// Where converted models are kept. Defaults to $KDB_MODEL_CACHE, or ModelCache
+	// in the working directory. An empty directory turns conversion off.
+	void setCacheDirectory(std::string directory);
+	
+	// Run the OSG optimizer over a model before it's written to the cache
+	void setOptimizeOnConvert(bool optimize);
+	
+	// LOD chain and mesh settings, change these before preloading anything
+	LODGenerator& getLODGenerator();
+	MeshOptimizer& getMeshOptimizer();
+	
+	// Loader thread
+	virtual void run();
+	
+private:
+	struct Entry
+	{
+		Entry() : loaded(false) {;}
+		osg::ref_ptr<osg::Node> node;
+		bool loaded;
+	};
+	
+	// Read a model from disk, this only ever runs on the loader thread
+	osg::ref_ptr<osg::Node> _load(const std::string& path);
+	
+	// Cached .ive file for a source file, empty if caching is off. Cache files
+	// are named <source name>.<mtime>-<settings>.ive, the source name being the
+	// full path flattened into a file name.
+	std::string _cachePath(const std::string& path);
+	std::string _cacheName(const std::string& path);
+	void _removeStaleCacheFiles(const std::string& path, const std::string& current);
+	
+	// Private variables
+	std::map<std::string, std::string> _resolvedPaths;
+	std::map<std::string, Entry> _entries;
+	std::vector<std::string> _queue;
+	OpenThreads::Mutex _mutex;
+	OpenThreads::Condition _condition;
+	std::string _cacheDirectory;
+	LODGenerator _lodGenerator;
+	MeshOptimizer _meshOptimizer;
+	bool _optimizeOnConvert;
+	bool _done;
+};
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ *  PhaseTimer.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/31/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "PhaseTimer.h"
+#include <iomanip>
+
+PhaseTimer::PhaseTimer()
+{
+	osg::Timer_t now = osg::Timer::instance()->tick();
+	for (int i = 0; i < NUM_PHASES; i++)
+	{
+		_depth[i] = 0;
+		_beginTick[i] = now;
+		_collectedTimes[i] = 0.0;
+		_collectedFirstTick[i] = _collectedLastTick[i] = now;
+		_collectedRan[i] = false;
+		_phaseTimes[i] = 0.0;
+		_averageTimes[i] = 0.0;
+		_firstTick[i] = _lastTick[i] = now;
+		_ran[i] = false;
+	}
+}
+
+void PhaseTimer::begin(Phase phase)
+{
+	if (_depth[phase]++ > 0)
+		return;
+
+	_beginTick[phase] = osg::Timer::instance()->tick();
+	if (!_collectedRan[phase])
+	{
+		_collectedFirstTick[phase] = _beginTick[phase];
+		_collectedRan[phase] = true;
+	}
+}
+
+void PhaseTimer::end(Phase phase)
+{
+	if (_depth[phase] == 0 || --_depth[phase] > 0)
+		return;
+
+	osg::Timer_t now = osg::Timer::instance()->tick();
+	_collectedTimes[phase] += osg::Timer::instance()->delta_m(_beginTick[phase], now);
+	_collectedLastTick[phase] = now;
+}
+
+void PhaseTimer::endFrame()
+{
+	for (int i = 0; i < NUM_PHASES; i++)
+	{
+		_phaseTimes[i] = _collectedTimes[i];
+		_firstTick[i] = _collectedFirstTick[i];
+		_lastTick[i] = _collectedLastTick[i];
+		_ran[i] = _collectedRan[i];
+		_averageTimes[i] = _averageTimes[i] * 0.9 + _phaseTimes[i] * 0.1;
+
+		// A phase still open carries over, it's counted when it ends
+		_collectedTimes[i] = 0.0;
+		_collectedRan[i] = _depth[i] > 0;
+		_collectedFirstTick[i] = _beginTick[i];
+	}
+}
+
+double PhaseTimer::getPhaseTime(Phase phase) const
+{
+	return _phaseTimes[phase];
+}
+
+double PhaseTimer::getAveragePhaseTime(Phase phase) const
+{
+	return _averageTimes[phase];
+}
+
+const char* PhaseTimer::getPhaseName(Phase phase)
+{
+	static const char* names[NUM_PHASES] = { "Input", "KVO", "Physics", "Scene", "Navigation" };
+	return names[phase];
+}
+
+void PhaseTimer::publish(osg::Stats* stats, int frameNumber, osg::Timer_t startTick)
+{
+	if (stats == NULL)
+		return;
+
+	// Phases that didn't run leave no bar rather than an empty one at zero
+	osg::Timer* timer = osg::Timer::instance();
+	for (int i = 0; i < NUM_PHASES; i++)
+	{
+		if (!_ran[i])
+			continue;
+
+		std::string name = std::string("App ") + getPhaseName((Phase)i);
+		stats->setAttribute(frameNumber, name + " begin time", timer->delta_s(startTick, _firstTick[i]));
+		stats->setAttribute(frameNumber, name + " end time", timer->delta_s(startTick, _lastTick[i]));
+		stats->setAttribute(frameNumber, name + " time taken", _phaseTimes[i] * 0.001);
+	}
+}
+
+void PhaseTimer::addStatsLines(AppStatsHandler* handler)
+{
+	osg::Vec4 colors[NUM_PHASES] =
+	{
+		osg::Vec4(0.9f, 0.4f, 0.7f, 1.0f),
+		osg::Vec4(0.7f, 0.5f, 0.9f, 1.0f),
+		osg::Vec4(0.9f, 0.6f, 0.2f, 1.0f),
+		osg::Vec4(0.3f, 0.9f, 0.7f, 1.0f),
+		osg::Vec4(0.5f, 0.7f, 1.0f, 1.0f),
+	};
+	for (int i = 0; i < NUM_PHASES; i++)
+	{
+		std::string name = std::string("App ") + getPhaseName((Phase)i);
+		handler->addUserStatsLine(std::string(getPhaseName((Phase)i)) + ":", colors[i], colors[i],
+								  name + " time taken", 1000.0, true, false,
+								  name + " begin time", name + " end time", 0.016);
+	}
+}
+
+void PhaseTimer::printReport(std::ostream& out) const
+{
+	out << "App (ms):";
+	for (int i = 0; i < NUM_PHASES; i++)
+		out << "  " << getPhaseName((Phase)i) << " " << std::fixed << std::setprecision(2) << _averageTimes[i];
+	out << std::endl;
+}
@@ -0,0 +1,84 @@
+/*
+ *  PhaseTimer.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/31/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _PHASETIMER_H_
+#define _PHASETIMER_H_
+
+#include "AppStatsHandler.h"
+
+// Times the app's own work per frame, the parts osgViewer's stats can't see:
+// input, KVO handling, physics, scene updates and navigation. Code brackets a
+// phase with begin()/end() or a Scope, as often as it likes in a frame. For each
+// phase the frame keeps the first begin and the last end, which place the bar,
+// and the sum of the brackets, which is the time taken.
+//
+// Brackets of a phase can nest, only the outermost one counts. Different phases
+// can nest too: KVO messages sent by the input controller are timed as KVO and
+// as part of INPUT. Everything is expected to run on the app thread.
+class PhaseTimer
+{
+public:
+	enum Phase { INPUT, KVO, PHYSICS, SCENE, NAVIGATION, NUM_PHASES };
+
+	static PhaseTimer& instance() { static PhaseTimer timer; return timer; }
+
+	void begin(Phase phase);
+	void end(Phase phase);
+
+	// Times the enclosing block
+	class Scope
+	{
+	public:
+		Scope(Phase phase) : _phase(phase) { PhaseTimer::instance().begin(_phase); }
+		~Scope() { PhaseTimer::instance().end(_phase); }
+	private:
+		Phase _phase;
+	};
+
+	// Close the frame being collected and start on the next one. Anything timed
+	// between frames, like GLUT's joystick callback, goes into the next frame.
+	void endFrame();
+
+	// Time in milliseconds spent in a phase during the last frame, and a smoothed version
+	double getPhaseTime(Phase phase) const;
+	double getAveragePhaseTime(Phase phase) const;
+	static const char* getPhaseName(Phase phase);
+
+	// Push the last frame into the viewer stats so the StatsHandler can draw it
+	void publish(osg::Stats* stats, int frameNumber, osg::Timer_t startTick);
+
+	// Register one stats line per phase with the StatsHandler
+	static void addStatsLines(AppStatsHandler* handler);
+
+	// Text version of the averages, used by the HUD and the Juggler build
+	void printReport(std::ostream& out) const;
+
+private:
+	// Constructor
+	PhaseTimer();
+
+	// Private variables
+	int _depth[NUM_PHASES];
+	osg::Timer_t _beginTick[NUM_PHASES];
+
+	// The frame being collected
+	double _collectedTimes[NUM_PHASES];
+	osg::Timer_t _collectedFirstTick[NUM_PHASES];
+	osg::Timer_t _collectedLastTick[NUM_PHASES];
+	bool _collectedRan[NUM_PHASES];
+
+	// The last frame closed by endFrame()
+	double _phaseTimes[NUM_PHASES];
+	double _averageTimes[NUM_PHASES];
+	osg::Timer_t _firstTick[NUM_PHASES];
+	osg::Timer_t _lastTick[NUM_PHASES];
+	bool _ran[NUM_PHASES];
+};
+
+#endif
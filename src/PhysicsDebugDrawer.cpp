@@ -0,0 +1,114 @@
+/*
+ *  PhysicsDebugDrawer.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/15/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "PhysicsDebugDrawer.h"
+
+PhysicsDebugDrawer::PhysicsDebugDrawer()
+{
+	_debugMode = DBG_DrawWireframe | DBG_DrawAabb | DBG_DrawContactPoints;
+	_enabled = false;
+	_suppressed = false;
+	
+	_vertices = new osg::Vec3Array();
+	_colors = new osg::Vec4Array();
+	_lines = new osg::DrawArrays(osg::PrimitiveSet::LINES, 0, 0);
+	
+	// The contents change every frame, so skip display lists and stream through a VBO
+	_geometry = new osg::Geometry();
+	_geometry->setDataVariance(osg::Object::DYNAMIC);
+	_geometry->setUseDisplayList(false);
+	_geometry->setUseVertexBufferObjects(true);
+	_geometry->setVertexArray(_vertices.get());
+	_geometry->setColorArray(_colors.get());
+	_geometry->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
+	_geometry->addPrimitiveSet(_lines.get());
+	
+	_geode = new osg::Geode();
+	_geode->addDrawable(_geometry.get());
+	_geode->setNodeMask(0x0);
+	
+	osg::StateSet* stateSet = _geode->getOrCreateStateSet();
+	stateSet->setMode(GL_LIGHTING, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+	stateSet->setTextureMode(0, GL_TEXTURE_2D, osg::StateAttribute::OFF);
+	stateSet->setRenderBinDetails(10, "RenderBin");
+}
+
+osg::Node* PhysicsDebugDrawer::getNode()
+{
+	return _geode.get();
+}
+
+void PhysicsDebugDrawer::setEnabled(bool enabled)
+{
+	_enabled = enabled;
+	_geode->setNodeMask((_enabled && !_suppressed) ? 0xffffffff : 0x0);
+}
+
+bool PhysicsDebugDrawer::isEnabled()
+{
+	return _enabled;
+}
+
+void PhysicsDebugDrawer::setSuppressed(bool suppressed)
+{
+	_suppressed = suppressed;
+	_geode->setNodeMask((_enabled && !_suppressed) ? 0xffffffff : 0x0);
+}
+
+void PhysicsDebugDrawer::update(btDynamicsWorld* world)
+{
+	if (!_enabled || _suppressed)
+		return;
+	
+	// clear() keeps the capacity from the previous frame
+	_vertices->clear();
+	_colors->clear();
+	
+	world->debugDrawWorld();
+	
+	_lines->setCount(_vertices->size());
+	_vertices->dirty();
+	_colors->dirty();
+	_geometry->dirtyBound();
+}
+
+void PhysicsDebugDrawer::drawLine(const btVector3& from, const btVector3& to, const btVector3& color)
+{
+	osg::Vec4 osgColor(color.x(), color.y(), color.z(), 1.0f);
+	_vertices->push_back(osg::Vec3(from.x(), from.y(), from.z()));
+	_vertices->push_back(osg::Vec3(to.x(), to.y(), to.z()));
+	_colors->push_back(osgColor);
+	_colors->push_back(osgColor);
+}
+
+void PhysicsDebugDrawer::drawContactPoint(const btVector3& pointOnB, const btVector3& normalOnB, btScalar distance, int lifeTime, const btVector3& color)
+{
+	// A short spike along the contact normal
+	drawLine(pointOnB, pointOnB + normalOnB * 0.25, color);
+}
+
+void PhysicsDebugDrawer::reportErrorWarning(const char* warningString)
+{
+	std::cout << "Bullet: " << warningString << std::endl;
+}
+
+void PhysicsDebugDrawer::draw3dText(const btVector3& location, const char* textString)
+{
+	// Text would need a node per string, which is exactly what we're avoiding
+}
+
+void PhysicsDebugDrawer::setDebugMode(int debugMode)
+{
+	_debugMode = debugMode;
+}
+
+int PhysicsDebugDrawer::getDebugMode() const
+{
+	return _debugMode;
+}
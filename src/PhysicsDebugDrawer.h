@@ -0,0 +1,56 @@
+/*
+ *  PhysicsDebugDrawer.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/15/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _PHYSICSDEBUGDRAWER_H_
+#define _PHYSICSDEBUGDRAWER_H_
+
+// Bullet debug drawer that batches every wireframe, contact point and AABB of a
+// frame into a single dynamic line geometry. The arrays are cleared but never
+// shrunk, so once the scene has settled there are no per-frame allocations and
+// the whole overlay is one draw call no matter how many bodies there are.
+class PhysicsDebugDrawer : public btIDebugDraw
+{
+public:
+	// Constructor
+	PhysicsDebugDrawer();
+	
+	// Node holding the line geometry, add it in the same space as the physics world
+	osg::Node* getNode();
+	
+	// Turning the overlay off hides the node and skips debugDrawWorld altogether
+	void setEnabled(bool enabled);
+	bool isEnabled();
+	
+	// Hide the overlay without changing what the user asked for, used by the quality governor
+	void setSuppressed(bool suppressed);
+	
+	// Rebuild the lines from the current state of the world
+	void update(btDynamicsWorld* world);
+	
+	// btIDebugDraw interface
+	virtual void drawLine(const btVector3& from, const btVector3& to, const btVector3& color);
+	virtual void drawContactPoint(const btVector3& pointOnB, const btVector3& normalOnB, btScalar distance, int lifeTime, const btVector3& color);
+	virtual void reportErrorWarning(const char* warningString);
+	virtual void draw3dText(const btVector3& location, const char* textString);
+	virtual void setDebugMode(int debugMode);
+	virtual int getDebugMode() const;
+	
+private:
+	// Private variables
+	osg::ref_ptr<osg::Geode> _geode;
+	osg::ref_ptr<osg::Geometry> _geometry;
+	osg::ref_ptr<osg::Vec3Array> _vertices;
+	osg::ref_ptr<osg::Vec4Array> _colors;
+	osg::ref_ptr<osg::DrawArrays> _lines;
+	int _debugMode;
+	bool _enabled;
+	bool _suppressed;
+};
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ *  PhysicsProfiler.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/14/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "PhysicsProfiler.h"
+#include <LinearMath/btQuickprof.h>
+#include <cstring>
+#include <iomanip>
+
+// Bullet's BT_PROFILE sample names and the stage each one belongs to. Only
+// these are counted, so nested samples are never added twice.
+struct StageSample
+{
+	const char* name;
+	PhysicsProfiler::Stage stage;
+};
+
+static const StageSample gStageSamples[] =
+{
+	{ "updateAabbs",					PhysicsProfiler::BROADPHASE },
+	{ "calculateOverlappingPairs",		PhysicsProfiler::BROADPHASE },
+	{ "dispatchAllCollisionPairs",		PhysicsProfiler::NARROWPHASE },
+	{ "calculateSimulationIslands",		PhysicsProfiler::SOLVER },
+	{ "solveConstraints",				PhysicsProfiler::SOLVER },
+	{ "predictUnconstraintMotion",		PhysicsProfiler::INTEGRATION },
+	{ "integrateTransforms",			PhysicsProfiler::INTEGRATION },
+	{ "updateActivationState",			PhysicsProfiler::INTEGRATION },
+	{ "synchronizeMotionStates",		PhysicsProfiler::INTEGRATION },
+	{ "stepSimulation",					PhysicsProfiler::TOTAL },
+};
+static const int NUM_STAGE_SAMPLES = sizeof(gStageSamples) / sizeof(gStageSamples[0]);
+
+PhysicsProfiler::PhysicsProfiler()
+{
+	for (int i = 0; i < NUM_STAGES; i++)
+	{
+		_stageTimes[i] = 0.0;
+		_averageTimes[i] = 0.0;
+	}
+	_stepBeginTick = _stepEndTick = osg::Timer::instance()->tick();
+}
+
+void PhysicsProfiler::beginStep()
+{
+	// Throw away anything recorded outside of stepSimulation
+	CProfileManager::Reset();
+	_stepBeginTick = osg::Timer::instance()->tick();
+}
+
+void PhysicsProfiler::endStep()
+{
+	_stepEndTick = osg::Timer::instance()->tick();
+
+	for (int i = 0; i < NUM_STAGES; i++)
+		_stageTimes[i] = 0.0;
+
+	CProfileIterator* iterator = CProfileManager::Get_Iterator();
+	_accumulate(iterator);
+	CProfileManager::Release_Iterator(iterator);
+
+	// Fall back on our own timer if Bullet was built with BT_NO_PROFILE
+	if (_stageTimes[TOTAL] == 0.0)
+		_stageTimes[TOTAL] = osg::Timer::instance()->delta_m(_stepBeginTick, _stepEndTick);
+
+	for (int i = 0; i < NUM_STAGES; i++)
+		_averageTimes[i] = _averageTimes[i] * 0.9 + _stageTimes[i] * 0.1;
+}
+
+void PhysicsProfiler::_accumulate(CProfileIterator* iterator)
+{
+	// Count the children first, Enter_Child loses our place in the sibling list
+	int numChildren = 0;
+	for (iterator->First(); !iterator->Is_Done(); iterator->Next())
+		numChildren++;
+
+	for (int child = 0; child < numChildren; child++)
+	{
+		iterator->First();
+		for (int i = 0; i < child; i++)
+			iterator->Next();
+
+		const char* name = iterator->Get_Current_Name();
+		for (int i = 0; i < NUM_STAGE_SAMPLES; i++)
+			if (strcmp(name, gStageSamples[i].name) == 0)
+				_stageTimes[gStageSamples[i].stage] += iterator->Get_Current_Total_Time();
+
+		iterator->Enter_Child(child);
+		_accumulate(iterator);
+		iterator->Enter_Parent();
+	}
+}
+
+double PhysicsProfiler::getStageTime(Stage stage) const
+{
+	return _stageTimes[stage];
+}
+
+double PhysicsProfiler::getAverageStageTime(Stage stage) const
+{
+	return _averageTimes[stage];
+}
+
+const char* PhysicsProfiler::getStageName(Stage stage)
+{
+	static const char* names[NUM_STAGES] = { "Broadphase", "Narrowphase", "Solver", "Integration", "Physics" };
+	return names[stage];
+}
+
+void PhysicsProfiler::publish(osg::Stats* stats, int frameNumber, osg::Timer_t startTick)
+{
+	if (stats == NULL)
+		return;
+
+	// Bullet interleaves the stages per substep, so the bars are laid out back
+	// to back from the start of the step. Their lengths are what matters.
+	osg::Timer* timer = osg::Timer::instance();
+	double begin = timer->delta_s(startTick, _stepBeginTick);
+	for (int i = 0; i < NUM_STAGES; i++)
+	{
+		std::string name = std::string("Physics ") + getStageName((Stage)i);
+		double taken = _stageTimes[i] * 0.001;
+		double stageBegin = (i == TOTAL) ? timer->delta_s(startTick, _stepBeginTick) : begin;
+		stats->setAttribute(frameNumber, name + " begin time", stageBegin);
+		stats->setAttribute(frameNumber, name + " end time", stageBegin + taken);
+		stats->setAttribute(frameNumber, name + " time taken", taken);
+		if (i != TOTAL)
+			begin += taken;
+	}
+}
+
+void PhysicsProfiler::addStatsLines(AppStatsHandler* handler)
+{
+	osg::Vec4 colors[NUM_STAGES] =
+	{
+		osg::Vec4(0.9f, 0.6f, 0.2f, 1.0f),
+		osg::Vec4(0.9f, 0.8f, 0.2f, 1.0f),
+		osg::Vec4(0.4f, 0.9f, 0.3f, 1.0f),
+		osg::Vec4(0.3f, 0.7f, 0.9f, 1.0f),
+		osg::Vec4(1.0f, 1.0f, 1.0f, 1.0f),
+	};
+	for (int i = 0; i < NUM_STAGES; i++)
+	{
+		std::string name = std::string("Physics ") + getStageName((Stage)i);
+		handler->addUserStatsLine(std::string(getStageName((Stage)i)) + ":", colors[i], colors[i],
+								  name + " time taken", 1000.0, true, false,
+								  name + " begin time", name + " end time", 0.016);
+	}
+}
+
+void PhysicsProfiler::printReport(std::ostream& out) const
+{
+	out << "Physics (ms):";
+	for (int i = 0; i < NUM_STAGES; i++)
+		out << "  " << getStageName((Stage)i) << " " << std::fixed << std::setprecision(2) << _averageTimes[i];
+	out << std::endl;
+}
@@ -0,0 +1,56 @@
+/*
+ *  PhysicsProfiler.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/14/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _PHYSICSPROFILER_H_
+#define _PHYSICSPROFILER_H_
+
+#include "AppStatsHandler.h"
+
+// Collects Bullet's built-in profiling samples (btQuickprof) once per frame and
+// sorts them into a handful of pipeline stages. The sample tree is reset after
+// every capture so each frame's numbers only cover that frame's stepSimulation.
+class PhysicsProfiler
+{
+public:
+	// The stages we report. TOTAL is the whole stepSimulation call.
+	enum Stage { BROADPHASE, NARROWPHASE, SOLVER, INTEGRATION, TOTAL, NUM_STAGES };
+
+	// Constructor
+	PhysicsProfiler();
+
+	// Bracket the stepSimulation call with these
+	void beginStep();
+	void endStep();
+
+	// Time in milliseconds spent in a stage during the last step, and a smoothed version
+	double getStageTime(Stage stage) const;
+	double getAverageStageTime(Stage stage) const;
+	static const char* getStageName(Stage stage);
+
+	// Push the last step into the viewer stats so the StatsHandler can draw it
+	void publish(osg::Stats* stats, int frameNumber, osg::Timer_t startTick);
+
+	// Register one stats line per stage with the StatsHandler
+	static void addStatsLines(AppStatsHandler* handler);
+
+	// Text version of the averages, used by the Juggler build
+	void printReport(std::ostream& out) const;
+
+private:
+	// Walk the btQuickprof tree under the iterator's current node
+	void _accumulate(CProfileIterator* iterator);
+
+	// Private variables
+	double _stageTimes[NUM_STAGES];
+	double _averageTimes[NUM_STAGES];
+	osg::Timer_t _stepBeginTick;
+	osg::Timer_t _stepEndTick;
+};
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ *  QualityGovernor.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/21/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "QualityGovernor.h"
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+// The quality levels from best to cheapest
+struct QualityLevel
+{
+	float resolutionScale;
+	bool multisample;
+	float lodScale;
+	bool debugOverlay;
+};
+
+static const QualityLevel gQualityLevels[] =
+{
+	{ 1.0f,		true,	1.0f,	true },
+	{ 1.0f,		true,	1.0f,	false },
+	{ 1.0f,		false,	1.0f,	false },
+	{ 1.0f,		false,	2.0f,	false },
+	{ 0.85f,	false,	2.0f,	false },
+	{ 0.7f,		false,	3.0f,	false },
+	{ 0.5f,		false,	4.0f,	false },
+};
+static const int NUM_QUALITY_LEVELS = sizeof(gQualityLevels) / sizeof(gQualityLevels[0]);
+
+// Over budget means 15% slower than the target, under budget 20% faster
+static const double OVER_BUDGET = 1.15;
+static const double UNDER_BUDGET = 0.8;
+
+// Seconds spent over budget before dropping a level, and the shortest time between changes
+static const double LOWER_DELAY = 0.5;
+static const double MIN_CHANGE_INTERVAL = 1.0;
+
+// Seconds under budget before raising a level, and the most it can back off to
+static const double RAISE_DELAY = 3.0;
+static const double MAX_RAISE_DELAY = 30.0;
+
+QualityGovernor::QualityGovernor()
+{
+	_targetFrameRate = 60.0;
+	_averageFrameTime = 0.0;
+	_overBudgetTime = 0.0;
+	_underBudgetTime = 0.0;
+	_timeSinceChange = 0.0;
+	_raiseDelay = RAISE_DELAY;
+	_lastChangeWasRaise = false;
+	_resolutionScaling = true;
+	_level = 0;
+}
+
+void QualityGovernor::setTargetFrameRate(double framesPerSecond)
+{
+	_targetFrameRate = framesPerSecond;
+	if (framesPerSecond <= 0.0)
+		_setLevel(0);
+}
+
+double QualityGovernor::getTargetFrameRate()
+{
+	return _targetFrameRate;
+}
+
+void QualityGovernor::setResolutionScalingEnabled(bool enabled)
+{
+	_resolutionScaling = enabled;
+	if (!_isUsable(_level))
+		_setLevel(_findLevel(-1));
+}
+
+bool QualityGovernor::getResolutionScalingEnabled()
+{
+	return _resolutionScaling;
+}
+
+void QualityGovernor::frame(double frameTime)
+{
+	frame(frameTime, frameTime);
+}
+
+void QualityGovernor::frame(double frameTime, double elapsed)
+{
+	// Skip hitches from pauses, loading or window moves
+	if (frameTime <= 0.0 || frameTime > 1.0 || elapsed > 1.0)
+		return;
+
+	if (_averageFrameTime == 0.0)
+		_averageFrameTime = frameTime;
+	else
+		_averageFrameTime = _averageFrameTime * 0.9 + frameTime * 0.1;
+
+	if (_targetFrameRate <= 0.0)
+		return;
+
+	double targetFrameTime = 1.0 / _targetFrameRate;
+	_timeSinceChange += elapsed;
+
+	if (_averageFrameTime > targetFrameTime * OVER_BUDGET)
+	{
+		_overBudgetTime += elapsed;
+		_underBudgetTime = 0.0;
+	}
+	else if (_averageFrameTime < targetFrameTime * UNDER_BUDGET)
+	{
+		_underBudgetTime += elapsed;
+		_overBudgetTime = 0.0;
+	}
+	else
+	{
+		_overBudgetTime = 0.0;
+		_underBudgetTime = 0.0;
+	}
+
+	if (_timeSinceChange < MIN_CHANGE_INTERVAL)
+		return;
+
+	int lower = _findLevel(1);
+	int raise = _findLevel(-1);
+	if (_overBudgetTime > LOWER_DELAY && lower != _level)
+	{
+		// Dropping right after a raise means the raise didn't fit, wait longer next time
+		if (_lastChangeWasRaise && _timeSinceChange < RAISE_DELAY + MIN_CHANGE_INTERVAL)
+			_raiseDelay = std::min(_raiseDelay * 2.0, MAX_RAISE_DELAY);
+		_lastChangeWasRaise = false;
+		_setLevel(lower);
+	}
+	else if (_underBudgetTime > _raiseDelay && raise != _level)
+	{
+		_lastChangeWasRaise = true;
+		_setLevel(raise);
+	}
+	else if (_timeSinceChange > MAX_RAISE_DELAY)
+	{
+		// Stable for a good while, forget about past back offs
+		_raiseDelay = RAISE_DELAY;
+	}
+}
+
+void QualityGovernor::_setLevel(int level)
+{
+	if (level == _level)
+		return;
+
+	_level = level;
+	_timeSinceChange = 0.0;
+	_overBudgetTime = 0.0;
+	_underBudgetTime = 0.0;
+	std::cout << "Quality governor: " << getDescription() << std::endl;
+}
+
+int QualityGovernor::_findLevel(int direction)
+{
+	for (int level = _level + direction; level >= 0 && level < NUM_QUALITY_LEVELS; level += direction)
+	{
+		if (_isUsable(level))
+			return level;
+	}
+	return _level;
+}
+
+bool QualityGovernor::_isUsable(int level)
+{
+	if (level == 0 || _resolutionScaling)
+		return true;
+
+	const QualityLevel& current = gQualityLevels[level];
+	const QualityLevel& above = gQualityLevels[level - 1];
+	return current.multisample != above.multisample || current.lodScale != above.lodScale ||
+		   current.debugOverlay != above.debugOverlay;
+}
+
+int QualityGovernor::getLevel()
+{
+	return _level;
+}
+
+int QualityGovernor::getNumLevels()
+{
+	return NUM_QUALITY_LEVELS;
+}
+
+float QualityGovernor::getResolutionScale()
+{
+	if (!_resolutionScaling)
+		return 1.0f;
+	return gQualityLevels[_level].resolutionScale;
+}
+
+bool QualityGovernor::getMultisample()
+{
+	return gQualityLevels[_level].multisample;
+}
+
+float QualityGovernor::getLODScale()
+{
+	return gQualityLevels[_level].lodScale;
+}
+
+bool QualityGovernor::getDebugOverlay()
+{
+	return gQualityLevels[_level].debugOverlay;
+}
+
+double QualityGovernor::getAverageFrameTime()
+{
+	return _averageFrameTime;
+}
+
+void QualityGovernor::applyStateSet(osg::StateSet* stateSet)
+{
+	// Only touch the state set when the decision changes
+	osg::StateAttribute::GLModeValue multisample = getMultisample() ? osg::StateAttribute::ON : osg::StateAttribute::OFF;
+	if (stateSet->getMode(GL_MULTISAMPLE_ARB) != multisample)
+		stateSet->setMode(GL_MULTISAMPLE_ARB, multisample);
+}
+
+void QualityGovernor::applyCullSettings(osg::CullSettings* cullSettings)
+{
+	cullSettings->setLODScale(getLODScale());
+}
+
+void QualityGovernor::publish(osg::Stats* stats, int frameNumber)
+{
+	if (stats == NULL)
+		return;
+
+	stats->setAttribute(frameNumber, "Quality level", _level);
+	stats->setAttribute(frameNumber, "Quality resolution scale", getResolutionScale());
+	stats->setAttribute(frameNumber, "Quality multisample", getMultisample() ? 1.0 : 0.0);
+	stats->setAttribute(frameNumber, "Quality LOD scale", getLODScale());
+	stats->setAttribute(frameNumber, "Quality frame time", _averageFrameTime);
+}
+
+void QualityGovernor::addStatsLines(AppStatsHandler* handler)
+{
+	osg::Vec4 color(0.8f, 0.8f, 1.0f, 1.0f);
+	handler->addUserStatsLine("Quality level:", color, color, "Quality level", 1.0, false, false, "", "", 0.0);
+	handler->addUserStatsLine("Resolution:", color, color, "Quality resolution scale", 1.0, false, false, "", "", 0.0);
+	handler->addUserStatsLine("MSAA:", color, color, "Quality multisample", 1.0, false, false, "", "", 0.0);
+	handler->addUserStatsLine("LOD scale:", color, color, "Quality LOD scale", 1.0, false, false, "", "", 0.0);
+}
+
+std::string QualityGovernor::getDescription()
+{
+	std::ostringstream description;
+	description << "level " << _level << "/" << NUM_QUALITY_LEVELS - 1
+				<< std::fixed << std::setprecision(2)
+				<< "  resolution " << getResolutionScale()
+				<< "  MSAA " << (getMultisample() ? "on" : "off")
+				<< "  LOD scale " << getLODScale()
+				<< "  overlays " << (getDebugOverlay() ? "on" : "off")
+				<< "  frame " << _averageFrameTime * 1000.0 << " ms";
+	return description.str();
+}
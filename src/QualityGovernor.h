@@ -0,0 +1,95 @@
+/*
+ *  QualityGovernor.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/21/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _QUALITYGOVERNOR_H_
+#define _QUALITYGOVERNOR_H_
+
+#include "AppStatsHandler.h"
+
+// Holds a target frame rate by trading image quality for speed. The governor
+// watches a smoothed frame time and steps through a fixed list of quality
+// levels: debug overlays go first, then multisampling, then LOD detail, then
+// render resolution. Dropping a level takes half a second over budget, going
+// back up takes a few seconds well under budget. Going back up and dropping
+// again straight away makes the next climb wait twice as long, so it doesn't
+// flip back and forth on the edge.
+//
+// The governor only decides. The front ends apply the decisions, since each
+// of them owns different parts (the GLUT window can render at a lower
+// resolution, the Juggler walls can't).
+class QualityGovernor
+{
+protected:
+	// Constructor
+	QualityGovernor();
+
+public:
+	// QualityGovernor is a singleton instance
+	static QualityGovernor& instance() { static QualityGovernor governor;  return governor; }
+
+	// Frames per second to hold, 0 turns the governor off and keeps full quality
+	void setTargetFrameRate(double framesPerSecond);
+	double getTargetFrameRate();
+
+	// Whether the front end can render at a lower resolution. Without it, the
+	// levels that only lower the resolution would change nothing, so they're
+	// skipped and the resolution scale stays at 1.
+	void setResolutionScalingEnabled(bool enabled);
+	bool getResolutionScalingEnabled();
+
+	// Feed the time the last frame took in seconds, once per frame. When frames
+	// are paced, pass the time spent working as frameTime and the wall clock
+	// time since the last call as elapsed, so waiting doesn't count as load.
+	void frame(double frameTime);
+	void frame(double frameTime, double elapsed);
+
+	// Current decisions
+	int getLevel();
+	int getNumLevels();
+	float getResolutionScale();
+	bool getMultisample();
+	float getLODScale();
+	bool getDebugOverlay();
+	double getAverageFrameTime();
+
+	// Multisampling is a mode on the root state set, LOD bias is on the camera
+	// (or the SceneView on the Juggler side)
+	void applyStateSet(osg::StateSet* stateSet);
+	void applyCullSettings(osg::CullSettings* cullSettings);
+
+	// Push the decisions into the viewer stats, and register lines for them
+	void publish(osg::Stats* stats, int frameNumber);
+	static void addStatsLines(AppStatsHandler* handler);
+
+	// One line summary for the text overlay and the Juggler console
+	std::string getDescription();
+
+private:
+	void _setLevel(int level);
+
+	// The next level from the current one in the given direction (1 cheaper,
+	// -1 better) that changes something, or the current level if there's none
+	int _findLevel(int direction);
+
+	// Whether a level changes anything over the one above it
+	bool _isUsable(int level);
+
+	// Private variables
+	double _targetFrameRate;
+	double _averageFrameTime;
+	double _overBudgetTime;
+	double _underBudgetTime;
+	double _timeSinceChange;
+	double _raiseDelay;
+	bool _lastChangeWasRaise;
+	bool _resolutionScaling;
+	int _level;
+};
+
+#endif
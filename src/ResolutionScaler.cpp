@@ -0,0 +1,121 @@
+/*
+ *  ResolutionScaler.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 01/03/10.
+ *  Copyright 2010 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "ResolutionScaler.h"
+
+// The render to texture camera's only child. Culling it culls the scaler's own
+// children, so they're shared with the scaler rather than copied.
+class ScaledChildren : public osg::Node
+{
+public:
+	ScaledChildren(ResolutionScaler* scaler) : _scaler(scaler) { setCullingActive(false); }
+
+	virtual void traverse(osg::NodeVisitor& nv) { _scaler->osg::Group::traverse(nv); }
+
+private:
+	// Private variables
+	ResolutionScaler* _scaler;
+};
+
+ResolutionScaler::ResolutionScaler()
+{
+	_width = 800;
+	_height = 600;
+	_scale = 1.0f;
+
+	// Stretches the texture over the whole window. Texture coordinates run from
+	// 0 to 1 and the texture matrix scales them to the pixels actually rendered.
+	_texMat = new osg::TexMat();
+	osg::Geode* geode = new osg::Geode();
+	geode->addDrawable(osg::createTexturedQuadGeometry(osg::Vec3(0.0f, 0.0f, 0.0f), osg::Vec3(1.0f, 0.0f, 0.0f), osg::Vec3(0.0f, 1.0f, 0.0f)));
+	osg::StateSet* stateSet = geode->getOrCreateStateSet();
+	stateSet->setMode(GL_LIGHTING, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+	stateSet->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF);
+	stateSet->setAttributeAndModes(new osg::Program(), osg::StateAttribute::ON | osg::StateAttribute::PROTECTED);
+	stateSet->setTextureAttribute(0, _texMat.get());
+
+	// Drawn by the main camera in place of the scene, with the main camera's
+	// viewport. Nothing else is drawn under it, so there's nothing to clear.
+	_quadCamera = new osg::Camera();
+	_quadCamera->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+	_quadCamera->setRenderOrder(osg::Camera::NESTED_RENDER);
+	_quadCamera->setClearMask(0);
+	_quadCamera->setProjectionMatrixAsOrtho2D(0, 1, 0, 1);
+	_quadCamera->setViewMatrix(osg::Matrix::identity());
+	_quadCamera->setAllowEventFocus(false);
+	_quadCamera->addChild(geode);
+
+	_createCamera();
+}
+
+void ResolutionScaler::setScreenSize(int width, int height)
+{
+	if (width == _width && height == _height)
+		return;
+
+	_width = width;
+	_height = height;
+	_createCamera();
+}
+
+void ResolutionScaler::setScale(float scale)
+{
+	_scale = osg::clampBetween(scale, 0.1f, 1.0f);
+
+	int renderWidth = osg::maximum((int)(_width * _scale), 1);
+	int renderHeight = osg::maximum((int)(_height * _scale), 1);
+	_camera->setViewport(0, 0, renderWidth, renderHeight);
+	_texMat->setMatrix(osg::Matrix::scale(renderWidth, renderHeight, 1.0));
+}
+
+float ResolutionScaler::getScale()
+{
+	return _scale;
+}
+
+void ResolutionScaler::traverse(osg::NodeVisitor& nv)
+{
+	// Everything but the cull sees the children once, as usual
+	if (_scale >= 1.0f || nv.getVisitorType() != osg::NodeVisitor::CULL_VISITOR)
+	{
+		osg::Group::traverse(nv);
+		return;
+	}
+
+	_camera->accept(nv);
+	_quadCamera->accept(nv);
+}
+
+void ResolutionScaler::_createCamera()
+{
+	// A rectangle texture the size of the window, so any scale fits without
+	// padding to a power of two
+	_texture = new osg::TextureRectangle();
+	_texture->setTextureSize(_width, _height);
+	_texture->setInternalFormat(GL_RGB);
+	_texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+	_texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+	_quadCamera->getChild(0)->getStateSet()->setTextureAttributeAndModes(0, _texture.get(), osg::StateAttribute::ON);
+
+	// Keeps the main camera's view and projection, only the viewport shrinks
+	osg::ref_ptr<osg::Camera> camera = new osg::Camera();
+	camera->setReferenceFrame(osg::Transform::RELATIVE_RF);
+	camera->setRenderOrder(osg::Camera::PRE_RENDER);
+	camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+	camera->attach(osg::Camera::COLOR_BUFFER, _texture.get());
+	camera->attach(osg::Camera::DEPTH_BUFFER, GL_DEPTH_COMPONENT24);
+	camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	camera->setClearColor(osg::Vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	camera->setCullingActive(false);
+	camera->setAllowEventFocus(false);
+	camera->addChild(new ScaledChildren(this));
+	_camera = camera;
+
+	setScale(_scale);
+}
@@ -0,0 +1,51 @@
+/*
+ *  ResolutionScaler.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 01/03/10.
+ *  Copyright 2010 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _RESOLUTIONSCALER_H_
+#define _RESOLUTIONSCALER_H_
+
+// Renders its children at a fraction of the window resolution, for when the
+// quality governor asks for fewer pixels. Below full scale the children are
+// culled by a render to texture camera whose viewport is the scaled size, and
+// a full window quad stretches the result over the window. Both cameras are
+// ordinary OSG cameras, so the state stays under OSG's tracking. Overlays that
+// should stay sharp (the HUD) belong next to the scaler, not under it.
+//
+// At full scale this is a plain group and costs nothing.
+class ResolutionScaler : public osg::Group
+{
+public:
+	// Constructor
+	ResolutionScaler();
+
+	// Window size in pixels, call on every reshape
+	void setScreenSize(int width, int height);
+
+	// Fraction of the window's width and height to render, 1 renders directly
+	void setScale(float scale);
+	float getScale();
+
+	virtual void traverse(osg::NodeVisitor& nv);
+
+private:
+	// Build the render target for the current window size. The texture's size
+	// is baked into the camera's FBO, so a new window size gets a new camera.
+	void _createCamera();
+
+	// Private variables
+	osg::ref_ptr<osg::Camera> _camera;
+	osg::ref_ptr<osg::TextureRectangle> _texture;
+	osg::ref_ptr<osg::Camera> _quadCamera;
+	osg::ref_ptr<osg::TexMat> _texMat;
+	int _width;
+	int _height;
+	float _scale;
+};
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ *  ShadowMap.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/18/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "ShadowMap.h"
+
+ShadowMap::ShadowMap(osg::StateSet* receiversStateSet, unsigned int size)
+{
+	_receiversStateSet = receiversStateSet;
+	_center = osg::Vec3(0, 0, 0);
+	_radius = 20.0;
+	_light = 1;
+	_lightPosition = osg::Vec4(0, 1, 0, 0);
+	_framesToRender = 1;
+	_renderThisFrame = true;
+	_enabled = true;
+
+	// Depth texture with hardware comparison, LINEAR gives 2x2 PCF on most cards
+	_depthTexture = new osg::Texture2D();
+	_depthTexture->setTextureSize(size, size);
+	_depthTexture->setInternalFormat(GL_DEPTH_COMPONENT);
+	_depthTexture->setShadowComparison(true);
+	_depthTexture->setShadowTextureMode(osg::Texture::LUMINANCE);
+	_depthTexture->setShadowCompareFunc(osg::Texture::LEQUAL);
+	_depthTexture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+	_depthTexture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+	_depthTexture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_BORDER);
+	_depthTexture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_BORDER);
+	_depthTexture->setBorderColor(osg::Vec4(1, 1, 1, 1));
+
+	// Depth only render to the texture, before the main scene
+	setNodeMask(NODE_MASK);
+	setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+	setRenderOrder(osg::Camera::PRE_RENDER);
+	setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+	setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+	setClearMask(GL_DEPTH_BUFFER_BIT);
+	setViewport(0, 0, size, size);
+	setDrawBuffer(GL_NONE);
+	setReadBuffer(GL_NONE);
+	attach(osg::Camera::DEPTH_BUFFER, _depthTexture.get());
+
+	// Push the depths back a bit to keep the casters from shadowing themselves.
+	// Nothing in the shadow pass samples the map it's writing.
+	osg::StateSet* stateSet = getOrCreateStateSet();
+	stateSet->setAttributeAndModes(new osg::PolygonOffset(1.1f, 4.0f), osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE);
+	stateSet->setMode(GL_LIGHTING, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
+	stateSet->addUniform(new osg::Uniform("kdb_ShadowEnabled", false), osg::StateAttribute::OVERRIDE);
+
+	// What the lighting shader needs on the receivers
+	_shadowEnabledUniform = new osg::Uniform("kdb_ShadowEnabled", true);
+	_shadowLightUniform = new osg::Uniform("kdb_ShadowLight", _light);
+	_shadowMatrixUniform = new osg::Uniform("kdb_ShadowMatrix", osg::Matrixf());
+	_shadowEnabledUniform->setDataVariance(osg::Object::DYNAMIC);
+	_shadowLightUniform->setDataVariance(osg::Object::DYNAMIC);
+	_shadowMatrixUniform->setDataVariance(osg::Object::DYNAMIC);
+	_receiversStateSet->setTextureAttributeAndModes(SHADOW_TEXTURE_UNIT, _depthTexture.get(), osg::StateAttribute::ON);
+	_receiversStateSet->addUniform(new osg::Uniform("kdb_ShadowMap", SHADOW_TEXTURE_UNIT));
+	_receiversStateSet->addUniform(_shadowEnabledUniform.get());
+	_receiversStateSet->addUniform(_shadowLightUniform.get());
+	_receiversStateSet->addUniform(_shadowMatrixUniform.get());
+
+	_updateLightMatrices();
+}
+
+void ShadowMap::setLight(int index)
+{
+	_light = index;
+	_shadowLightUniform->set(index);
+	dirty();
+}
+
+int ShadowMap::getLight()
+{
+	return _light;
+}
+
+void ShadowMap::setLightPosition(osg::Vec4 position)
+{
+	if (position == _lightPosition)
+		return;
+
+	_lightPosition = position;
+	_updateLightMatrices();
+	dirty();
+}
+
+void ShadowMap::setRegion(osg::Vec3 center, float radius)
+{
+	_center = center;
+	_radius = radius;
+	_updateLightMatrices();
+	dirty();
+}
+
+void ShadowMap::setNavigationMatrix(const osg::Matrixf& matrix)
+{
+	// The receivers hand us world positions, the map is in navigation space
+	_inverseNavigation = osg::Matrixd::inverse(matrix);
+	_shadowMatrixUniform->set(osg::Matrixf(_inverseNavigation * _lightMatrix));
+}
+
+void ShadowMap::_updateLightMatrices()
+{
+	// Orthographic view down the light direction, covering the whole region
+	osg::Vec3 direction(_lightPosition.x(), _lightPosition.y(), _lightPosition.z());
+	if (_lightPosition.w() != 0.0)
+		direction -= _center;
+	direction.normalize();
+
+	osg::Vec3 up = (fabs(direction.y()) > 0.99) ? osg::Vec3(0, 0, 1) : osg::Vec3(0, 1, 0);
+	setViewMatrixAsLookAt(_center + direction * _radius * 2.0, _center, up);
+	setProjectionMatrixAsOrtho(-_radius, _radius, -_radius, _radius, _radius, _radius * 3.0);
+
+	// Clip space to texture space
+	osg::Matrixd bias = osg::Matrixd::translate(1.0, 1.0, 1.0) * osg::Matrixd::scale(0.5, 0.5, 0.5);
+	_lightMatrix = getViewMatrix() * getProjectionMatrix() * bias;
+	_shadowMatrixUniform->set(osg::Matrixf(_inverseNavigation * _lightMatrix));
+}
+
+void ShadowMap::update(bool bodiesMoving)
+{
+	// One extra frame after things stop so the final resting place gets in
+	if (bodiesMoving)
+		_framesToRender = 2;
+
+	_renderThisFrame = (_enabled && _framesToRender > 0);
+	if (_renderThisFrame)
+		_framesToRender--;
+}
+
+void ShadowMap::accept(osg::NodeVisitor& nv)
+{
+	if (nv.getVisitorType() == osg::NodeVisitor::CULL_VISITOR && !_shouldRender(nv))
+		return;
+	osg::Camera::accept(nv);
+}
+
+bool ShadowMap::_shouldRender(osg::NodeVisitor& nv)
+{
+	if (!_enabled)
+		return false;
+
+	// Culls for several contexts can run at once
+	osgUtil::CullVisitor* cullVisitor = dynamic_cast<osgUtil::CullVisitor*>(&nv);
+	unsigned int contextID = (cullVisitor && cullVisitor->getState()) ? cullVisitor->getState()->getContextID() : 0;
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_renderedContextsMutex);
+	bool firstTime = _renderedContexts.insert(contextID).second;
+	return _renderThisFrame || firstTime;
+}
+
+void ShadowMap::dirty()
+{
+	if (_framesToRender < 1)
+		_framesToRender = 1;
+}
+
+void ShadowMap::setShadowsEnabled(bool enabled)
+{
+	_enabled = enabled;
+	_shadowEnabledUniform->set(enabled);
+	if (enabled)
+		dirty();
+}
+
+bool ShadowMap::getShadowsEnabled()
+{
+	return _enabled;
+}
@@ -0,0 +1,87 @@
+/*
+ *  ShadowMap.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/18/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _SHADOWMAP_H_
+#define _SHADOWMAP_H_
+
+#include <set>
+
+// Depth-only render of the shadow casters from one of the LightsGroup lights,
+// used by the lighting shader to shadow that light. The map is kept between
+// frames. The camera is only culled when something could have moved (an
+// active physics body) or the light changed, so a settled scene just samples
+// the cached texture and the shadow pass costs nothing. Every graphics context
+// has its own copy of the texture, so a context is always rendered for the
+// first time it culls the map, whether or not the scene is asleep by then.
+//
+// Add the casters as children. The camera renders in navigation space, so it
+// belongs above the navigation transform.
+class ShadowMap : public osg::Camera
+{
+public:
+	// Constructor, the shadow texture and uniforms go on the receivers' state set
+	ShadowMap(osg::StateSet* receiversStateSet, unsigned int size = 2048);
+
+	// Which light casts the shadows, and where it is (navigation space, w = 0 for directional)
+	void setLight(int index);
+	int getLight();
+	void setLightPosition(osg::Vec4 position);
+
+	// Region of the scene covered by the map, in navigation space
+	void setRegion(osg::Vec3 center, float radius);
+
+	// Keep the shadow lookup in step with navigation, call whenever it changes
+	void setNavigationMatrix(const osg::Matrixf& matrix);
+
+	// Decide whether the map is rendered this frame. Call once per frame.
+	void update(bool bodiesMoving);
+
+	// Force a re-render on the next update
+	void dirty();
+
+	void setShadowsEnabled(bool enabled);
+	bool getShadowsEnabled();
+
+	// Texture unit the shadow map is bound to on the receivers
+	static const int SHADOW_TEXTURE_UNIT = 2;
+
+	// The map's node mask. Views that share a context with one that renders
+	// the map (the C6 walls) leave this bit out of their cull mask and sample
+	// the texture it left behind.
+	static const unsigned int NODE_MASK = 0x40000000;
+
+	// Skips the cull, and with it the whole render stage, on frames the map is kept
+	virtual void accept(osg::NodeVisitor& nv);
+
+private:
+	void _updateLightMatrices();
+
+	// Whether a cull should render the map, see accept()
+	bool _shouldRender(osg::NodeVisitor& nv);
+
+	// Private variables
+	osg::ref_ptr<osg::StateSet> _receiversStateSet;
+	osg::ref_ptr<osg::Texture2D> _depthTexture;
+	osg::ref_ptr<osg::Uniform> _shadowEnabledUniform;
+	osg::ref_ptr<osg::Uniform> _shadowLightUniform;
+	osg::ref_ptr<osg::Uniform> _shadowMatrixUniform;
+	osg::Matrixd _lightMatrix;
+	osg::Matrixd _inverseNavigation;
+	osg::Vec4 _lightPosition;
+	osg::Vec3 _center;
+	float _radius;
+	int _light;
+	int _framesToRender;
+	bool _renderThisFrame;
+	bool _enabled;
+	std::set<unsigned int> _renderedContexts;
+	OpenThreads::Mutex _renderedContextsMutex;
+};
+
+#endif
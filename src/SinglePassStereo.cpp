@@ -0,0 +1,143 @@
+/*
+ *  SinglePassStereo.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/30/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "SinglePassStereo.h"
+
+// Lets the cull visitor make one of these by name
+static osgUtil::RegisterRenderBinProxy s_registerStereoRenderBin("StereoRenderBin", new StereoRenderBin);
+
+SinglePassStereo::SinglePassStereo()
+{
+	_eyeSeparation = 0.065;
+	_convergenceDistance = 5.0;
+	_enabled = false;
+}
+
+void SinglePassStereo::setEnabled(bool enabled)
+{
+	_enabled = enabled;
+	std::cout << "Single pass stereo " << (enabled ? "on" : "off") << std::endl;
+}
+
+bool SinglePassStereo::isEnabled()
+{
+	return _enabled;
+}
+
+void SinglePassStereo::setEyeSeparation(double separation)
+{
+	_eyeSeparation = separation;
+}
+
+void SinglePassStereo::setConvergenceDistance(double distance)
+{
+	if (distance > 0.0)
+		_convergenceDistance = distance;
+}
+
+void SinglePassStereo::traverse(osg::NodeVisitor& nv)
+{
+	osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(&nv);
+	double left, right, bottom, top, zNear, zFar;
+	if (!_enabled || !cv || !cv->getProjectionMatrix()->getFrustum(left, right, bottom, top, zNear, zFar))
+	{
+		osg::Group::traverse(nv);
+		return;
+	}
+
+	// Parallel eyes half the separation either side of the head, with off-axis
+	// frusta that line up at the convergence distance
+	double halfSeparation = _eyeSeparation * 0.5;
+	double shift = halfSeparation * zNear / _convergenceDistance;
+	osg::Matrix leftEye = osg::Matrix::translate(halfSeparation, 0.0, 0.0) *
+		osg::Matrix::frustum(left + shift, right + shift, bottom, top, zNear, zFar);
+	osg::Matrix rightEye = osg::Matrix::translate(-halfSeparation, 0.0, 0.0) *
+		osg::Matrix::frustum(left - shift, right - shift, bottom, top, zNear, zFar);
+
+	// Slopes of the left eye's left side and the right eye's right side. Where
+	// they cross is the apex of the frustum that holds both eyes.
+	double leftSlope = (left + shift) / zNear;
+	double rightSlope = (right - shift) / zNear;
+	if (rightSlope <= leftSlope)
+	{
+		// Converging closer than the near plane, there's no such frustum
+		osg::Group::traverse(nv);
+		return;
+	}
+	double pullBack = _eyeSeparation / (rightSlope - leftSlope);
+	double apexX = -halfSeparation - leftSlope * pullBack;
+	double cullNear = zNear + pullBack;
+	double cullFar = zFar + pullBack;
+	osg::ref_ptr<osg::RefMatrix> projection = new osg::RefMatrix(osg::Matrix::translate(-apexX, 0.0, -pullBack) *
+		osg::Matrix::frustum(leftSlope * cullNear, rightSlope * cullNear, bottom / zNear * cullNear, top / zNear * cullNear, cullNear, cullFar));
+
+	// Everything below goes into the stereo bin, culled against the combined frustum
+	osgUtil::RenderBin* previousBin = cv->getCurrentRenderBin();
+	StereoRenderBin* bin = dynamic_cast<StereoRenderBin*>(previousBin->find_or_insert(0, "StereoRenderBin"));
+	if (!bin)
+	{
+		osg::Group::traverse(nv);
+		return;
+	}
+	bin->setEyes(projection.get(), leftEye, rightEye);
+
+	cv->setCurrentRenderBin(bin);
+	cv->pushProjectionMatrix(projection.get());
+	osg::Group::traverse(nv);
+	cv->popProjectionMatrix();
+	cv->setCurrentRenderBin(previousBin);
+}
+
+StereoRenderBin::StereoRenderBin()
+{
+}
+
+StereoRenderBin::StereoRenderBin(const StereoRenderBin& bin, const osg::CopyOp& copyop) :
+	osgUtil::RenderBin(bin, copyop)
+{
+	_projection = bin._projection;
+	_eyeProjections[0] = bin._eyeProjections[0];
+	_eyeProjections[1] = bin._eyeProjections[1];
+}
+
+void StereoRenderBin::setEyes(osg::RefMatrix* projection, const osg::Matrix& leftEye, const osg::Matrix& rightEye)
+{
+	_projection = projection;
+	_eyeProjections[0] = leftEye;
+	_eyeProjections[1] = rightEye;
+}
+
+void StereoRenderBin::drawImplementation(osg::RenderInfo& renderInfo, osgUtil::RenderLeaf*& previous)
+{
+	osg::State& state = *renderInfo.getState();
+	osg::Viewport* viewport = getStage() ? getStage()->getViewport() : NULL;
+	if (!_projection.valid() || !viewport)
+	{
+		osgUtil::RenderBin::drawImplementation(renderInfo, previous);
+		return;
+	}
+
+	// With the window's viewport current, leaves that carry it in their state
+	// leave the eye's half alone
+	state.applyAttribute(viewport);
+
+	int halfWidth = (int)viewport->width() / 2;
+	for (int eye = 0; eye < 2; eye++)
+	{
+		glViewport((GLint)viewport->x() + eye * halfWidth, (GLint)viewport->y(), halfWidth, (GLsizei)viewport->height());
+
+		// Same matrix object as last time, so the state has to be told to load it again
+		_projection->set(_eyeProjections[eye]);
+		state.applyProjectionMatrix(NULL);
+
+		osgUtil::RenderBin::drawImplementation(renderInfo, previous);
+	}
+
+	viewport->apply(state);
+}
@@ -0,0 +1,73 @@
+/*
+ *  SinglePassStereo.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/30/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _SINGLEPASSSTEREO_H_
+#define _SINGLEPASSSTEREO_H_
+
+// Stereo from one cull traversal. The children are culled once against a
+// frustum that holds both eyes' frusta: its apex is pulled back behind the head
+// to where the outer sides of the two eye frusta meet, d = e / (tan a + tan b)
+// for eyes e apart whose outer sides open at angles a and b. Everything that
+// survives goes into one StereoRenderBin, which draws its leaves twice, once
+// per eye, into the left and right halves of the window.
+//
+// The leaves keep the head's modelview, so lighting is worked out from between
+// the eyes. Each eye's offset is folded into the projection instead, which is
+// the one matrix the leaves share and the bin can swap between the two draws.
+//
+// Overlays rendered by their own cameras (the HUD) are drawn once, over the
+// whole window. With stereo off this is a plain group.
+class SinglePassStereo : public osg::Group
+{
+public:
+	// Constructor
+	SinglePassStereo();
+
+	void setEnabled(bool enabled);
+	bool isEnabled();
+
+	// Distance between the eyes and distance at which their views converge,
+	// in scene units
+	void setEyeSeparation(double separation);
+	void setConvergenceDistance(double distance);
+
+	virtual void traverse(osg::NodeVisitor& nv);
+
+private:
+	// Private variables
+	double _eyeSeparation;
+	double _convergenceDistance;
+	bool _enabled;
+};
+
+// Draws its leaves once per eye, each time with that eye's projection and half
+// of the stage's viewport. Created by name through the render bin prototypes,
+// and told about the eyes by SinglePassStereo during the cull.
+class StereoRenderBin : public osgUtil::RenderBin
+{
+public:
+	// Constructor
+	StereoRenderBin();
+	StereoRenderBin(const StereoRenderBin& bin, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY);
+
+	META_Object(kdb, StereoRenderBin);
+
+	// The projection every leaf in the bin was culled with, and what it becomes
+	// for each eye's draw
+	void setEyes(osg::RefMatrix* projection, const osg::Matrix& leftEye, const osg::Matrix& rightEye);
+
+	virtual void drawImplementation(osg::RenderInfo& renderInfo, osgUtil::RenderLeaf*& previous);
+
+private:
+	// Private variables
+	osg::ref_ptr<osg::RefMatrix> _projection;
+	osg::Matrix _eyeProjections[2];
+};
+
+#endif
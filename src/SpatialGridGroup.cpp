@@ -0,0 +1,246 @@
+/*
+ *  SpatialGridGroup.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/30/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include <algorithm>
+#include "SpatialGridGroup.h"
+
+// A cell's query node. Every new bound swaps out the query geometry's vertices,
+// so the geometry is drawn as DYNAMIC: with a draw thread per context, the
+// viewer holds the next frame until the draw thread is done with it.
+class CellQueryNode : public osg::OcclusionQueryNode
+{
+public:
+	CellQueryNode()
+	{
+		_queryGeode->getDrawable(0)->setDataVariance(osg::Object::DYNAMIC);
+		_debugGeode->getDrawable(0)->setDataVariance(osg::Object::DYNAMIC);
+	}
+};
+
+SpatialGridGroup::SpatialGridGroup(osg::Vec3 cellSize)
+{
+	_cellSize = cellSize;
+	_parallel = true;
+	_occlusionCulling = false;
+}
+
+SpatialGridGroup::~SpatialGridGroup()
+{
+	clear();
+}
+
+void SpatialGridGroup::addObject(osg::MatrixTransform* node, btRigidBody* body)
+{
+	Object object;
+	object.node = node;
+	object.body = body;
+	object.motionState = new DeferredMotionState(body->getWorldTransform());
+	object.key = _getCellKey(body);
+	object.cell = _getCell(object.key);
+	body->setMotionState(object.motionState);
+	_objects.push_back(object);
+
+	// Work out the bound of whatever the transform holds now, while it's on
+	// one thread. It's static and shared, so update() only ever reads it.
+	node->getBound();
+
+	object.cell->objects.push_back(_objects.size() - 1);
+	object.cell->node->addChild(node);
+}
+
+void SpatialGridGroup::clear()
+{
+	for (unsigned int i = 0; i < _objects.size(); i++)
+	{
+		_objects[i].body->setMotionState(NULL);
+		delete _objects[i].motionState;
+	}
+	_objects.clear();
+	_cells.clear();
+	_dirtyCells.clear();
+	removeChildren(0, getNumChildren());
+}
+
+unsigned int SpatialGridGroup::getNumObjects()
+{
+	return _objects.size();
+}
+
+unsigned int SpatialGridGroup::getNumCells()
+{
+	return _cells.size();
+}
+
+void SpatialGridGroup::update()
+{
+	// Rebin in object order
+	for (unsigned int i = 0; i < _objects.size(); i++)
+	{
+		Object& object = _objects[i];
+		if (!object.motionState->changed)
+			continue;
+
+		CellKey key = _getCellKey(object.body);
+		if (key != object.key)
+		{
+			// Hold on to the node while it's between cells
+			osg::ref_ptr<osg::MatrixTransform> node = object.node;
+			_removeFromCell(i, object.key);
+			object.key = key;
+			object.cell = _getCell(key);
+			object.cell->objects.push_back(i);
+			object.cell->node->addChild(node.get());
+		}
+	}
+
+	// Dirty the cells up front, then the transforms below find their parents
+	// already dirty and the tasks never write to anything another task can see
+	_dirtyCells.clear();
+	for (unsigned int i = 0; i < _objects.size(); i++)
+	{
+		Object& object = _objects[i];
+		Cell* cell = object.cell;
+		if (object.motionState->changed && !cell->dirty)
+		{
+			cell->dirty = true;
+			cell->node->dirtyBound();
+			_dirtyCells.push_back(cell);
+		}
+	}
+
+	ApplyTask task(this);
+	if (_parallel)
+		WorkerPool::instance().run(task, _dirtyCells.size());
+	else
+	{
+		for (unsigned int i = 0; i < _dirtyCells.size(); i++)
+			task(i, 0);
+	}
+
+	// A query node runs a bounds visitor over its cell and builds new query
+	// geometry for every bound, which is no job for the pool
+	if (_occlusionCulling)
+	{
+		for (unsigned int i = 0; i < _dirtyCells.size(); i++)
+			_dirtyCells[i]->node->getBound();
+	}
+}
+
+void SpatialGridGroup::ApplyTask::operator()(unsigned int index, unsigned int worker)
+{
+	Cell* cell = _group->_dirtyCells[index];
+	for (unsigned int i = 0; i < cell->objects.size(); i++)
+	{
+		Object& object = _group->_objects[cell->objects[i]];
+		if (!object.motionState->changed)
+			continue;
+
+		btScalar matrix[16];
+		object.motionState->transform.getOpenGLMatrix(matrix);
+		object.node->setMatrix(osg::Matrix(matrix));
+		object.motionState->changed = false;
+	}
+
+	// Cull would do this anyway, but one cell at a time on its own thread
+	if (!_group->_occlusionCulling)
+		cell->node->getBound();
+	cell->dirty = false;
+}
+
+void SpatialGridGroup::setParallel(bool parallel)
+{
+	_parallel = parallel;
+}
+
+bool SpatialGridGroup::isParallel()
+{
+	return _parallel;
+}
+
+void SpatialGridGroup::setOcclusionCulling(bool enabled)
+{
+	if (enabled == _occlusionCulling)
+		return;
+
+	_occlusionCulling = enabled;
+	_regroup();
+}
+
+bool SpatialGridGroup::getOcclusionCulling()
+{
+	return _occlusionCulling;
+}
+
+SpatialGridGroup::CellKey SpatialGridGroup::_getCellKey(btRigidBody* body)
+{
+	// The middle of the broadphase AABB, which Bullet keeps up to date anyway
+	btVector3 aabbMin, aabbMax;
+	body->getAabb(aabbMin, aabbMax);
+	btVector3 center = (aabbMin + aabbMax) * 0.5;
+
+	CellKey key;
+	for (int i = 0; i < 3; i++)
+		key.v[i] = (int)floorf(center[i] / _cellSize[i]);
+	return key;
+}
+
+SpatialGridGroup::Cell* SpatialGridGroup::_getCell(const CellKey& key)
+{
+	osg::ref_ptr<Cell>& cell = _cells[key];
+	if (!cell.valid())
+	{
+		cell = new Cell();
+		if (_occlusionCulling)
+		{
+			osg::OcclusionQueryNode* queryNode = new CellQueryNode();
+			queryNode->setVisibilityThreshold(50);
+			queryNode->setQueryFrameCount(5);
+			cell->node = queryNode;
+		}
+		else
+			cell->node = new osg::Group();
+		addChild(cell->node.get());
+	}
+	return cell.get();
+}
+
+void SpatialGridGroup::_removeFromCell(unsigned int object, const CellKey& key)
+{
+	std::map< CellKey, osg::ref_ptr<Cell> >::iterator iter = _cells.find(key);
+	if (iter == _cells.end())
+		return;
+
+	Cell* cell = iter->second.get();
+	cell->objects.erase(std::find(cell->objects.begin(), cell->objects.end(), object));
+	cell->node->removeChild(_objects[object].node.get());
+	if (cell->objects.empty())
+	{
+		removeChild(cell->node.get());
+		_cells.erase(iter);
+	}
+}
+
+void SpatialGridGroup::_regroup()
+{
+	std::map< CellKey, osg::ref_ptr<Cell> >::iterator iter;
+	for (iter = _cells.begin(); iter != _cells.end(); iter++)
+		iter->second->node->removeChildren(0, iter->second->node->getNumChildren());
+	_cells.clear();
+	_dirtyCells.clear();
+	removeChildren(0, getNumChildren());
+
+	// Same keys, the bodies haven't moved, just new cells to hang them under
+	for (unsigned int i = 0; i < _objects.size(); i++)
+	{
+		Object& object = _objects[i];
+		object.cell = _getCell(object.key);
+		object.cell->objects.push_back(i);
+		object.cell->node->addChild(object.node.get());
+	}
+}
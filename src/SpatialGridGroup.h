@@ -0,0 +1,147 @@
+/*
+ *  SpatialGridGroup.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/30/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _SPATIALGRIDGROUP_H_
+#define _SPATIALGRIDGROUP_H_
+
+#include "WorkerPool.h"
+
+// Holds transforms that move with rigid bodies, filed into a uniform grid by
+// where their bodies are. Each grid cell is a child group whose bound covers
+// only the objects in it, so cull and intersection visitors throw away whole
+// regions at once instead of testing every object. BDScene keeps one for the
+// launched objects and one for the wall's boxes when they aren't instanced;
+// the instanced wall writes its matrix buffer from its own motion states.
+//
+// The group hands each body a motion state that only records the transform
+// Bullet gives it. update(), called once after each physics step, does the rest
+// in two passes:
+//
+//   - in object order, on the calling thread: objects whose centers crossed
+//     into another cell are moved there, and every cell with a moving object is
+//     marked dirty, so nothing below has to touch shared nodes.
+//   - across the WorkerPool, one cell per task: the recorded transforms are
+//     written into that cell's MatrixTransforms and, for plain group cells,
+//     the cell's bound is recomputed, ready for cull.
+//
+// Cells never share nodes they write to, so the second pass comes out the same
+// however its tasks are scheduled. Sleeping bodies cost nothing. Cells are
+// created as objects arrive and dropped when they empty.
+//
+// With occlusion culling on the cells are osg::OcclusionQueryNodes, like the
+// box wall's, so clusters of objects hidden behind the wall are skipped. With
+// it off they're plain groups, which don't rebuild query geometry every time
+// their bound changes. Changing the setting rebuilds the cells. A query node's
+// bound is recomputed on the calling thread after the pool is done, since it
+// allocates new query geometry each time.
+//
+// Add objects with addObject(), not addChild(), the children are the cells.
+class SpatialGridGroup : public osg::Group
+{
+public:
+	// Constructor
+	SpatialGridGroup(osg::Vec3 cellSize = osg::Vec3(8, 8, 8));
+
+	// File a transform under the cell its body is in, and take over the body's
+	// motion state. The body has to stay alive until clear(), which is what
+	// BDScene's reset does.
+	void addObject(osg::MatrixTransform* node, btRigidBody* body);
+	void clear();
+	unsigned int getNumObjects();
+	unsigned int getNumCells();
+
+	// Apply the transforms from the last step. Call once per frame.
+	void update();
+
+	// Run update() on the WorkerPool, on by default. Off does the same work in
+	// the same order on the calling thread.
+	void setParallel(bool parallel);
+	bool isParallel();
+
+	void setOcclusionCulling(bool enabled);
+	bool getOcclusionCulling();
+
+protected:
+	virtual ~SpatialGridGroup();
+
+private:
+	// Grid coordinates of a cell. A plain struct, so working out an object's
+	// cell every frame doesn't allocate.
+	struct CellKey
+	{
+		int v[3];
+		bool operator<(const CellKey& other) const
+		{
+			if (v[0] != other.v[0]) return v[0] < other.v[0];
+			if (v[1] != other.v[1]) return v[1] < other.v[1];
+			return v[2] < other.v[2];
+		}
+		bool operator==(const CellKey& other) const { return v[0] == other.v[0] && v[1] == other.v[1] && v[2] == other.v[2]; }
+		bool operator!=(const CellKey& other) const { return !(*this == other); }
+	};
+
+	// Keeps Bullet's transform until update() gets to it
+	class DeferredMotionState : public btMotionState
+	{
+	public:
+		DeferredMotionState(const btTransform& transform) : transform(transform), changed(true) {;}
+		virtual void getWorldTransform(btTransform& worldTrans) const { worldTrans = transform; }
+		virtual void setWorldTransform(const btTransform& worldTrans) { transform = worldTrans; changed = true; }
+		btTransform transform;
+		bool changed;
+	};
+
+	struct Cell;
+
+	// The cell is kept by key and by pointer, so update() only goes through the
+	// cell map when an object changes cells
+	struct Object
+	{
+		osg::ref_ptr<osg::MatrixTransform> node;
+		btRigidBody* body;
+		DeferredMotionState* motionState;
+		CellKey key;
+		Cell* cell;
+	};
+
+	struct Cell : public osg::Referenced
+	{
+		Cell() : dirty(false) {;}
+		osg::ref_ptr<osg::Group> node;
+		std::vector<unsigned int> objects;
+		bool dirty;
+	};
+
+	// Writes one cell's transforms and recomputes a plain group cell's bound
+	class ApplyTask : public WorkerPool::Task
+	{
+	public:
+		ApplyTask(SpatialGridGroup* group) : _group(group) {;}
+		virtual void operator()(unsigned int index, unsigned int worker);
+	private:
+		SpatialGridGroup* _group;
+	};
+
+	CellKey _getCellKey(btRigidBody* body);
+	Cell* _getCell(const CellKey& key);
+	void _removeFromCell(unsigned int object, const CellKey& key);
+
+	// Refile every object into new cells of the current kind
+	void _regroup();
+
+	// Private variables
+	std::vector<Object> _objects;
+	std::map< CellKey, osg::ref_ptr<Cell> > _cells;
+	std::vector<Cell*> _dirtyCells;
+	osg::Vec3 _cellSize;
+	bool _parallel;
+	bool _occlusionCulling;
+};
+
+#endif
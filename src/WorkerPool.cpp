@@ -0,0 +1,133 @@
+/*
+ *  WorkerPool.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/31/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool()
+{
+	int processors = OpenThreads::GetNumberOfProcessors();
+	_numThreads = processors > 1 ? processors - 1 : 0;
+	_task = NULL;
+	_count = 0;
+	_next = 0;
+	_busy = 0;
+	_generation = 0;
+	_done = false;
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+		_done = true;
+		_condition.broadcast();
+	}
+
+	for (unsigned int i = 0; i < _workers.size(); i++)
+	{
+		_workers[i]->join();
+		delete _workers[i];
+	}
+}
+
+void WorkerPool::setNumThreads(unsigned int numThreads)
+{
+	if (!_workers.empty())
+	{
+		std::cout << "WorkerPool: threads are already running, keeping " << _workers.size() << std::endl;
+		return;
+	}
+	_numThreads = numThreads;
+}
+
+unsigned int WorkerPool::getNumWorkers()
+{
+	return _numThreads + 1;
+}
+
+void WorkerPool::run(Task& task, unsigned int count)
+{
+	// Nothing to share, or nobody to share it with
+	if (count <= 1 || _numThreads == 0)
+	{
+		for (unsigned int i = 0; i < count; i++)
+			task(i, 0);
+		return;
+	}
+
+	if (_workers.empty())
+		_start();
+
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+		_task = &task;
+		_count = count;
+		_next = 0;
+		_busy = _workers.size() + 1;
+		_generation++;
+		_condition.broadcast();
+	}
+
+	_runTask(0);
+
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+	while (_busy > 0)
+		_finished.wait(&_mutex);
+	_task = NULL;
+}
+
+void WorkerPool::_start()
+{
+	for (unsigned int i = 0; i < _numThreads; i++)
+	{
+		_workers.push_back(new Worker(this, i + 1));
+		_workers.back()->start();
+	}
+	std::cout << "WorkerPool: " << _numThreads << " worker threads" << std::endl;
+}
+
+void WorkerPool::_work(unsigned int worker)
+{
+	unsigned int generation = 0;
+	while (true)
+	{
+		{
+			OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+			while (_generation == generation && !_done)
+				_condition.wait(&_mutex);
+			if (_done)
+				return;
+			generation = _generation;
+		}
+
+		_runTask(worker);
+	}
+}
+
+void WorkerPool::_runTask(unsigned int worker)
+{
+	while (true)
+	{
+		unsigned int index;
+		{
+			OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+			if (_next >= _count)
+			{
+				// Out of indices, the last one out wakes the caller
+				_busy--;
+				if (_busy == 0)
+					_finished.broadcast();
+				return;
+			}
+			index = _next++;
+		}
+
+		(*_task)(index, worker);
+	}
+}
@@ -0,0 +1,77 @@
+/*
+ *  WorkerPool.h
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/31/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+#ifndef _WORKERPOOL_H_
+#define _WORKERPOOL_H_
+
+// A few threads that sit waiting to run the same task over a range of indices.
+// run() hands the indices out one at a time to the workers and the calling
+// thread, and returns once every index is done, so the caller can treat it like
+// a loop. Which thread gets which index isn't fixed; tasks should write their
+// results per index and leave anything order dependent to the caller.
+//
+// The threads are started on the first run() that has more than one index.
+class WorkerPool
+{
+protected:
+	// Constructor
+	WorkerPool();
+	virtual ~WorkerPool();
+
+public:
+	// WorkerPool is a singleton instance
+	static WorkerPool& instance() { static WorkerPool pool;  return pool; }
+
+	class Task
+	{
+	public:
+		virtual ~Task() {;}
+
+		// Called once per index. Worker 0 is the calling thread, the rest are
+		// numbered from 1, for tasks that keep scratch space per thread.
+		virtual void operator()(unsigned int index, unsigned int worker) = 0;
+	};
+
+	void run(Task& task, unsigned int count);
+
+	// Threads besides the calling one, one per extra core by default. Set this
+	// before the first run().
+	void setNumThreads(unsigned int numThreads);
+	unsigned int getNumWorkers();
+
+private:
+	class Worker : public OpenThreads::Thread
+	{
+	public:
+		Worker(WorkerPool* pool, unsigned int index) : _pool(pool), _index(index) {;}
+		virtual void run() { _pool->_work(_index); }
+	private:
+		WorkerPool* _pool;
+		unsigned int _index;
+	};
+
+	void _start();
+	void _work(unsigned int worker);
+	void _runTask(unsigned int worker);
+
+	// Private variables
+	std::vector<Worker*> _workers;
+	unsigned int _numThreads;
+	Task* _task;
+	unsigned int _count;
+	unsigned int _next;
+	unsigned int _busy;
+	unsigned int _generation;
+	bool _done;
+	OpenThreads::Mutex _mutex;
+	OpenThreads::Condition _condition;
+	OpenThreads::Condition _finished;
+};
+
+#endif
@@ -0,0 +1,266 @@
+/*
+ *  mainBenchmark.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/29/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+// Renders the scene offscreen along a scripted camera path, launching gliders
+// on a fixed schedule, and prints percentiles of the per-frame update, cull,
+// draw and total times. Physics steps a fixed 1/60 s per frame, so every run
+// sees the same bodies in the same places no matter how fast it renders.
+//
+// Usage: mainBenchmark [--frames n] [--warmup n] [--size w h] [--wall c r l] [--no-instancing]
+//                      [--occlusion] [--no-shadows] [--fixed-function] [--stereo] [--csv file]
+//                      [--projectiles n] [--serial] [--threads n] [--mesh-stages n]
+//
+// --stereo renders side by side stereo from one cull, to compare against mono.
+//
+// --projectiles launches that many gliders in a burst before the run, to load
+// up the update. Compare the update times with and without --serial to see
+// what the worker pool buys, --threads sets how many workers it has. With
+// --no-instancing the wall's boxes go through the same pool.
+//
+// --mesh-stages picks the MeshOptimizer stages the glider is converted with (a
+// sum of MeshOptimizer::Stages, 0 for none). The draw times of a run with many
+// --projectiles and 0 against one with the default show what the optimizer
+// buys in vertex throughput. Each setting is cached separately.
+//
+// Nothing is shown on screen. The frames go to a pbuffer, so machines without
+// a display can run it under a virtual X server with Mesa's software
+// rasterizer, e.g.
+//
+//     xvfb-run env LIBGL_ALWAYS_SOFTWARE=1 mainBenchmark --frames 1200
+
+#include <algorithm>
+#include <fstream>
+#include "BDScene.h"
+#include "GLObjectCompiler.h"
+#include "ModelCache.h"
+#include "SinglePassStereo.h"
+#include "WorkerPool.h"
+
+// Wall of boxes the camera circles, the same defaults as BDScene
+int gWallColumns = 20;
+int gWallRows = 12;
+int gWallLayers = 1;
+
+// A glider every this many frames
+const int LAUNCH_INTERVAL = 45;
+
+// Waits for the GPU before the draw traversal is timed as finished, otherwise
+// the draw time only counts how long it took to queue the commands
+class FinishCallback : public osg::Camera::DrawCallback
+{
+public:
+	virtual void operator()(osg::RenderInfo& renderInfo) const
+	{
+		glFinish();
+	}
+};
+
+// Eye position along the scripted path: half a circle around the front of the
+// wall, bobbing up and down, at a fraction of the way through the run
+osg::Matrixd getScriptedViewMatrix(double fraction)
+{
+	osg::Vec3d center(0.0, gWallRows * 0.5, -5.0);
+	double angle = osg::PI * (fraction - 0.5);
+	double radius = 12.0 + gWallColumns * 0.4;
+	osg::Vec3d eye = center + osg::Vec3d(radius * sin(angle), 2.0 + 1.5 * sin(fraction * osg::PI * 4.0), radius * cos(angle));
+	return osg::Matrixd::lookAt(eye, center, osg::Vec3d(0.0, 1.0, 0.0));
+}
+
+// Launches go through the same KVO keys as the keyboard, every other glider
+// goes a little to the left
+void scriptedLaunch(int launch)
+{
+	bool aimLeft = (launch % 2 == 1);
+	if (aimLeft)
+		aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Aim_Left");
+	aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Drop ball");
+	if (aimLeft)
+		aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Aim_Right");
+}
+
+// A block of gliders over the ground in front of the wall, thrown up and
+// outward so they spread over many grid cells. Seeded, so every run gets the
+// same burst.
+void launchBurst(int count)
+{
+	srand(1);
+	int side = (int)ceil(sqrt((double)count));
+	for (int i = 0; i < count; i++)
+	{
+		osg::Vec3 position((i % side - side / 2) * 2.0, 3.0, 10.0 + (i / side) * 2.0);
+		osg::Vec3 velocity(rand() % 21 - 10, 5 + rand() % 10, rand() % 21 - 10);
+		BDScene::instance().launchObject(position, velocity);
+	}
+	std::cout << "Launched " << count << " gliders into " << BDScene::instance().getLaunchedObjects()->getNumCells() << " grid cells" << std::endl;
+}
+
+// Nearest rank percentile of a set of times, in milliseconds
+double percentile(std::vector<double> times, double p)
+{
+	if (times.empty())
+		return 0.0;
+	std::sort(times.begin(), times.end());
+	unsigned int rank = (unsigned int)ceil(p / 100.0 * times.size());
+	if (rank < 1)
+		rank = 1;
+	return times[rank - 1] * 1000.0;
+}
+
+void printPercentiles(const char* name, const std::vector<double>& times)
+{
+	printf("  %-8s p50 %8.2f ms   p95 %8.2f ms   p99 %8.2f ms\n", name, percentile(times, 50.0), percentile(times, 95.0), percentile(times, 99.0));
+}
+
+int main( int argc, char **argv )
+{
+	osg::ArgumentParser arguments(&argc, argv);
+
+	// Length of the run, the warmup frames aren't counted
+	int numFrames = 600;
+	int numWarmupFrames = 60;
+	arguments.read("--frames", numFrames);
+	arguments.read("--warmup", numWarmupFrames);
+
+	int width = 1024;
+	int height = 768;
+	arguments.read("--size", width, height);
+
+	if (arguments.read("--wall", gWallColumns, gWallRows, gWallLayers))
+		BDScene::instance().setWallSize(gWallColumns, gWallRows, gWallLayers);
+	if (arguments.read("--no-instancing"))
+		BDScene::instance().setUseInstancedBoxes(false);
+
+	std::string csvName;
+	arguments.read("--csv", csvName);
+
+	bool occlusion = arguments.read("--occlusion");
+	bool noShadows = arguments.read("--no-shadows");
+	bool fixedFunction = arguments.read("--fixed-function");
+	bool stereo = arguments.read("--stereo");
+
+	// Launched objects and wall boxes updated on one thread or across the worker pool
+	int numProjectiles = 0;
+	arguments.read("--projectiles", numProjectiles);
+	bool serial = arguments.read("--serial");
+	int numThreads;
+	if (arguments.read("--threads", numThreads))
+		WorkerPool::instance().setNumThreads(numThreads);
+
+	// Has to be set before BDScene preloads the glider
+	unsigned int meshStages;
+	if (arguments.read("--mesh-stages", meshStages))
+		ModelCache::instance().getMeshOptimizer().setStages(meshStages);
+
+	BDScene::instance().setMaster(true);
+	BDScene::instance().init();
+	BDScene::instance().setOcclusionCullingEnabled(occlusion);
+	BDScene::instance().setShaderLightingEnabled(!fixedFunction);
+	BDScene::instance().setShadowsEnabled(!noShadows && !fixedFunction);
+	BDScene::instance().getLaunchedObjects()->setParallel(!serial);
+	BDScene::instance().getBoxes()->setParallel(!serial);
+	if (numProjectiles > 0)
+		launchBurst(numProjectiles);
+
+	// An offscreen buffer instead of a window
+	osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+	traits->width = width;
+	traits->height = height;
+	traits->pbuffer = true;
+	traits->doubleBuffer = false;
+	traits->windowDecoration = false;
+	osg::ref_ptr<osg::GraphicsContext> context = osg::GraphicsContext::createGraphicsContext(traits.get());
+	if (!context.valid())
+	{
+		std::cout << "Couldn't create a " << width << " x " << height << " pbuffer" << std::endl;
+		return 1;
+	}
+
+	// Everything on this thread, so the cull and draw times are the whole story
+	osg::ref_ptr<osgViewer::Viewer> viewer = new osgViewer::Viewer;
+	viewer->setThreadingModel(osgViewer::ViewerBase::SingleThreaded);
+	osg::ref_ptr<SinglePassStereo> stereoGroup = new SinglePassStereo();
+	stereoGroup->addChild(BDScene::instance().getRootNode());
+	stereoGroup->setEnabled(stereo);
+	viewer->setSceneData(stereoGroup.get());
+
+	osg::Camera* camera = viewer->getCamera();
+	camera->setGraphicsContext(context.get());
+	camera->setViewport(0, 0, width, height);
+	camera->setDrawBuffer(GL_FRONT);
+	camera->setReadBuffer(GL_FRONT);
+	camera->setClearColor(osg::Vec4f(0.0, 0.0, 0.0, 1.0));
+	camera->setProjectionMatrixAsPerspective(60, 1.0 * width / height, 0.1, 5000.0);
+	camera->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+	camera->setPreDrawCallback(new GLObjectCompiler::CompileCallback);
+	camera->setFinalDrawCallback(new FinishCallback);
+	camera->getStats()->collectStats("rendering", true);
+	viewer->realize();
+
+	const osg::Timer* timer = osg::Timer::instance();
+	const double dt = 1.0 / 60.0;
+	std::vector<double> updateTimes, cullTimes, drawTimes, totalTimes;
+	int launch = 0;
+
+	std::cout << "Benchmarking " << numFrames << " frames at " << width << " x " << height
+			  << " after " << numWarmupFrames << " warmup frames, launched objects updated "
+			  << (serial ? "serially" : "in parallel") << " on " << (serial ? 1 : WorkerPool::instance().getNumWorkers()) << " threads" << std::endl;
+
+	for (int frame = 0; frame < numWarmupFrames + numFrames && !viewer->done(); frame++)
+	{
+		osg::Timer_t frameStart = timer->tick();
+
+		if (frame % LAUNCH_INTERVAL == 0)
+			scriptedLaunch(launch++);
+		BDScene::instance().update(dt);
+		osg::Timer_t updateEnd = timer->tick();
+
+		// The warmup frames hold the camera at the start of the path
+		double fraction = frame < numWarmupFrames ? 0.0 : (double)(frame - numWarmupFrames) / numFrames;
+		osg::Matrixd viewMatrix = getScriptedViewMatrix(fraction);
+		camera->setViewMatrix(viewMatrix);
+		BDScene::instance().setHeadMatrix(osg::Matrixf(osg::Matrixd::inverse(viewMatrix)));
+		BDScene::instance().setWandMatrix(osg::Matrixf(osg::Matrixd::translate(0.0, -0.3, -2.0) * osg::Matrixd::inverse(viewMatrix)));
+
+		viewer->frame(frame * dt);
+		osg::Timer_t frameEnd = timer->tick();
+
+		if (frame < numWarmupFrames)
+			continue;
+
+		// Cull and draw as the renderer timed them
+		double cullTime = 0.0, drawTime = 0.0;
+		int frameNumber = viewer->getFrameStamp()->getFrameNumber();
+		camera->getStats()->getAttribute(frameNumber, "Cull traversal time taken", cullTime);
+		camera->getStats()->getAttribute(frameNumber, "Draw traversal time taken", drawTime);
+
+		updateTimes.push_back(timer->delta_s(frameStart, updateEnd));
+		cullTimes.push_back(cullTime);
+		drawTimes.push_back(drawTime);
+		totalTimes.push_back(timer->delta_s(frameStart, frameEnd));
+	}
+
+	std::cout << "Frame times over " << totalTimes.size() << " frames, " << launch << " launches, "
+			  << BDScene::instance().getNumActiveBodies() << " bodies awake at the end:" << std::endl;
+	printPercentiles("update", updateTimes);
+	printPercentiles("cull", cullTimes);
+	printPercentiles("draw", drawTimes);
+	printPercentiles("total", totalTimes);
+
+	// Every frame for plotting, in milliseconds
+	if (!csvName.empty())
+	{
+		std::ofstream csv(csvName.c_str());
+		csv << "frame,update,cull,draw,total" << std::endl;
+		for (unsigned int i = 0; i < totalTimes.size(); i++)
+			csv << i << "," << updateTimes[i] * 1000.0 << "," << cullTimes[i] * 1000.0 << "," << drawTimes[i] * 1000.0 << "," << totalTimes[i] * 1000.0 << std::endl;
+		std::cout << "Wrote per-frame times to " << csvName << std::endl;
+	}
+
+	return 0;
+}
@@ -8,9 +8,18 @@
 #  include <GL/glut.h>
 #endif
 
-#include <stdarg.h>
+#include <sstream>
 #include "BDScene.h"
+#include "HUD.h"
+#include "KeyboardMapping.h"
+#include "FrameScheduler.h"
+#include "FrameRecorder.h"
+#include "C6Preview.h"
+#include "SinglePassStereo.h"
+#include "ResolutionScaler.h"
 #include "OSGNavigatorGLUT.h"
+#include "GLObjectCompiler.h"
+#include "QualityGovernor.h"
 
 #include <gmtl/Vec.h>
 #include <gmtl/Coord.h>
@@ -36,7 +45,8 @@ bool gPaused = false;
 bool gFullScreen;
 int gMouseX, gMouseY;
 
-bool gShowC6 = true;
+bool gShowC6 = false;		//show all six cave walls instead of the main view?
+int gWindow;
 
 OsgNavigatorGLUT _osgNavigator;
 float _navSpeed = 1.0;
@@ -51,63 +61,59 @@ pthread_t _socketThread;
 #include "CameraController.h"
 
 CameraController gCamera;
+FrameScheduler gScheduler;
 
 
 osg::ref_ptr<osgViewer::Viewer> viewer;
 osg::observer_ptr<osgViewer::GraphicsWindow> window;
 
-void drawStringOnScreen(int x, int y, const char* format, ...)
-{
-	char stringData[1024];
-	va_list args;
-	va_start(args, format);
-	vsprintf(stringData, format, args);
-	glViewport(0, 0, screenWidth, screenHeight);
-	glPushMatrix();
-		glLoadIdentity();
-		glMatrixMode(GL_PROJECTION);
-		glPushMatrix();
-			glLoadIdentity();
-			glOrtho(0, screenWidth, 0, screenHeight, -1, 1);
-
-			//glDisable(GL_LIGHTING);
-			glDisable(GL_TEXTURE_2D);
-			glRasterPos3i(x, screenHeight - y, 0);
-			for ( int i=0; i<1024 && stringData[i] != 0; i++ )
-				glutBitmapCharacter( GLUT_BITMAP_HELVETICA_12, stringData[i] );
-			//glEnable(GL_LIGHTING);
-		glPopMatrix();
-		glMatrixMode(GL_MODELVIEW);
-	glPopMatrix();
+// Frame rate and friends, drawn by OSG with the rest of the scene
+osg::ref_ptr<HUD> gHUD;
 
+// Session recording, toggled with 'v'
+osg::ref_ptr<FrameRecorder> gRecorder;
 
-}
+// The six C6 walls, toggled with 'c'
+osg::ref_ptr<C6Preview> gC6Preview;
+osg::ref_ptr<SinglePassStereo> gStereo;
+
+// Renders the scene at the governor's resolution, the HUD stays outside it
+osg::ref_ptr<ResolutionScaler> gScaler;
 
-void drawStatus()
+void timer(int generation);
+void notifyActivity();
+
+void updateStatus()
 {
-	glColor3f(1,1,1);
 	static float t=0;
 	static float fps=2;
 	static float deltat=.2;
 	static int reps=0;
 	float tnow=glutGet(GLUT_ELAPSED_TIME);
 	reps++;
-//printf("%f\n", tnow - t);
 	if (tnow - t > 500)		//update every 500 ms
 	{
-	//	printf("upd\n");
-		//float tnow=glutGet(GLUT_ELAPSED_TIME);
 		deltat=tnow-t;
 		t=tnow;
 		fps=1.f * reps/deltat*1000;
 		reps = 0;
+		
+		// The HUD only rebuilds a line when its text changes, so only touch it twice a second
+		std::ostringstream physics;
+		BDScene::instance().getPhysicsProfiler()->printReport(physics);
+		std::string physicsLine = physics.str();
+		physicsLine.erase(physicsLine.find_last_not_of('\n') + 1);
+		
+		std::ostringstream phases;
+		PhaseTimer::instance().printReport(phases);
+		std::string phasesLine = phases.str();
+		phasesLine.erase(phasesLine.find_last_not_of('\n') + 1);
+		
+		gHUD->setLinef(0, "Frame Rate:             %.2f", fps);
+		gHUD->setLinef(1, "Quality:                %s", QualityGovernor::instance().getDescription().c_str());
+		gHUD->setLine(2, physicsLine);
+		gHUD->setLine(3, phasesLine);
 	}
-	
-		drawStringOnScreen(20, 20, "Frame Rate:             %.2f", fps);
-	
-	glColor3f(1, 0, 0);
-	
-
 }
 
 void drawTheFPSGuy()
@@ -171,23 +177,17 @@ void setLight(float x, float y, float z)
 
 
 
-void display(void)
+// Render the scene graph into the back buffer
+void drawFrame()
 {
-    // update and render the scene graph
 	osg::Camera* currentCam = viewer->getCamera();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
 	currentCam->setProjectionMatrixAsPerspective(60, aspect, 0.1, 5000.0);
 //	currentCam->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
-	gluPerspective(60, aspect, 0.1, 5000.0);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	//apply our chosen matrix!	
+	//our chosen matrix, OSG does the rest.  the camera math is all on the CPU and cached,
+	//so asking for the same view again below is free
 	KMatrix view = gCamera.getViewMatrix();
 
-	glLoadMatrixf(view.m);
-
 	//use this time to get the head and wand matrices and pass them to our app.  
 	//this only works because GLUT uses a single OpenGL context.  if you send matrices to a C6 
 	//app while you're drawing, bad things will happen	
@@ -211,27 +211,31 @@ void display(void)
 	BDScene::instance().setWandMatrix(osg::Matrixf(wandMat.m));
 
 	currentCam->setViewMatrix(osg::Matrixf(view.m));
-    if (viewer.valid()) viewer->frame();
 	
-	//go back to our view so we can draw some extras
-	glViewport(0, 0, screenWidth, screenHeight);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glDisable(GL_BLEND);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	osg::Matrixf proj = 	currentCam->getProjectionMatrix();
-	glMultMatrixf(proj.ptr());
-	glMatrixMode(GL_MODELVIEW);
-	glLoadMatrixf(view.m);
-//	setLight(50, 50, 50);
-//	glEnable(GL_DEPTH_TEST);
-//	if (gCamera.getViewMode() != CameraController::FPS_VIEW)
-//		drawTheFPSGuy();
-//	//glDisable(GL_LIGHTING);
-	drawStatus();
-	
-    // Swap Buffers
-    glutSwapBuffers();
+	if (gShowC6)
+	{
+		// Every wall from the FPS head, drawn by its own viewer. GLUT owns the
+		// context, so the walls are culled one after the other here.
+		gC6Preview->setHeadMatrix(osg::Matrixf(gCamera.getViewMatrix(CameraController::FPS_VIEW).m));
+		gC6Preview->getViewer()->frame();
+	}
+	else
+	{
+		// The scaler renders the scene smaller when the governor asks for less
+		// resolution, the HUD is drawn over it at full size either way
+		currentCam->setViewport(0, 0, screenWidth, screenHeight);
+		gScaler->setScale(QualityGovernor::instance().getResolutionScale());
+		
+		if (viewer.valid()) viewer->frame();
+	}
+}
+
+// Redraws GLUT asks for between frames, after an expose or input. The frames
+// themselves are drawn by timer(), these aren't timed or recorded.
+void display(void)
+{
+	drawFrame();
+	glutSwapBuffers();
 }
 
 
@@ -244,6 +248,15 @@ void reshape( int w, int h )
 	aspect = 1.0 * screenWidth / screenHeight;
 	printf("reshape to %i, %i\n", screenWidth, screenHeight);
 	glViewport(0, 0, screenWidth, screenHeight);
+	if (gHUD.valid())
+		gHUD->setScreenSize(screenWidth, screenHeight);
+	if (gScaler.valid())
+		gScaler->setScreenSize(screenWidth, screenHeight);
+	if (gC6Preview.valid())
+	{
+		gC6Preview->getView(C6Preview::FRONT)->getCamera()->getGraphicsContext()->resized(0, 0, w, h);
+		gC6Preview->setScreenSize(screenWidth, screenHeight);
+	}
     // update the window dimensions, in case the window has been resized.
     if (window.valid()) 
     {
@@ -254,6 +267,7 @@ void reshape( int w, int h )
 
 void mousebutton( int button, int state, int x, int y )
 {
+	notifyActivity();
   	gCamera.mouseClick(button, state, x, y);
 	y = screenHeight - y;
 	gMouseX = x;
@@ -269,6 +283,7 @@ void mousebutton( int button, int state, int x, int y )
 
 void mouseMotion(int x, int y)
 {
+	notifyActivity();
 	gCamera.mouseMotion(x, y);
 	y = screenHeight - y;
 	gMouseX = x;
@@ -290,6 +305,7 @@ void mouser(int button, int state, int x, int y)
 
 void passiveMotion(int x, int y)
 {
+	notifyActivity();
 	gCamera.passiveMouse(x, y);
 	y = screenHeight - y;
 	gMouseX = x;
@@ -299,28 +315,20 @@ void passiveMotion(int x, int y)
 
 void keyboard(unsigned char key, int x, int y)
 {
-	switch(key)
+	notifyActivity();
+	// Scene and camera keys are the same for every desktop front end
+	if (KeyboardMapping::keyDown(key, gCamera))
 	{
-		//handle key input	
-		case '1': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Mass_1");	break;
-		case '2': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Mass_2");	break;
-		case '3': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Mass_3");	break;
-		case 'R': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Reset_Scene");	break;
-		case 'b': aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Drop ball");	break;
-			
-		case 'q': gCamera.setStrafeLeft(true);	break;
-		case 'w': gCamera.setUp(true);	break;
-		case 'e': gCamera.setStrafeRight(true);	break;
-		case 'a': gCamera.setLeft(true);	break;
-		case 's': gCamera.setDown(true);	break;
-		case 'd': gCamera.setRight(true);	break;
+		glutPostRedisplay();
+		return;
+	}
 	
+	switch(key)
+	{
 		case 'c': gShowC6 = !gShowC6; break;
-		case ' ':	BDScene::instance().buttonInput(0, true);	break;		//space bar controls the main wand button
-	
+		case 'x':	gStereo->setEnabled(!gStereo->isEnabled());	break;		//side by side stereo on/off
 		case 'p':	gPaused = !gPaused;	break;		//pause/unpause
-		//switch input modes with tab
-		case '	':	gCamera.cycleViewMode();	break;
+		case 'v':	gRecorder->toggleRecording();	break;		//start/stop recording
 		case 'f':
 			if (!gFullScreen)	glutFullScreen();
 			else glutReshapeWindow(1024, 768);
@@ -334,7 +342,18 @@ void keyboard(unsigned char key, int x, int y)
 			_moveDown = true;
 			glutForceJoystickFunc();
 			break;
-		case 27:	exit(1);	break;
+		case 27:
+			// Same report as the osgViewer front end, to compare the two
+			gScheduler.printSummary("GLUT");
+			
+			// Drain the recorder while the context is still here
+			if (gRecorder->isRecording())
+			{
+				gRecorder->setRecording(false);
+				gRecorder->capture(*viewer->getCamera()->getGraphicsContext()->getState(), 0, 0, screenWidth, screenHeight);
+			}
+			exit(1);
+			break;
 		default:
             if (window.valid())
             {
@@ -358,12 +377,13 @@ void keyboardUp(unsigned char key, int x, int y)
 
 void keySpecial(int key, int x, int y)
 {
+	notifyActivity();
 	switch(key)
 	{
-		case GLUT_KEY_LEFT: aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Aim_Left");	break;
-		case GLUT_KEY_RIGHT: aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Aim_Right");	break;
-		case GLUT_KEY_DOWN: aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Aim_Down");	break;
-		case GLUT_KEY_UP: aq::KVReflector::instance()->didUpdateValueForKey((double)1.0, "Aim_Up");	break;
+		case GLUT_KEY_LEFT: KeyboardMapping::arrowKey(KeyboardMapping::ARROW_LEFT);	break;
+		case GLUT_KEY_RIGHT: KeyboardMapping::arrowKey(KeyboardMapping::ARROW_RIGHT);	break;
+		case GLUT_KEY_DOWN: KeyboardMapping::arrowKey(KeyboardMapping::ARROW_DOWN);	break;
+		case GLUT_KEY_UP: KeyboardMapping::arrowKey(KeyboardMapping::ARROW_UP);	break;
 			
 		default: break;
 
@@ -372,40 +392,88 @@ void keySpecial(int key, int x, int y)
 
 }
 
-void timer(int bl)
+// Anything that means the next frame will look different from this one
+bool sceneIsActive()
 {
-	static int lastTime = glutGet(GLUT_ELAPSED_TIME);
-	int thisTime = glutGet(GLUT_ELAPSED_TIME);
-	float dt = 0.001 * ((float) thisTime - lastTime);
-	lastTime = thisTime;
+	if (!gPaused && BDScene::instance().getNumActiveBodies() > 0)
+		return true;
+	return gCamera.isMoving();
+}
+
+void timer(int generation)
+{
+	// Replaced by a timer armed when input woke the scheduler
+	if ((unsigned int)generation != gScheduler.getGeneration())
+		return;
+	
+	float dt = gScheduler.beginFrame(sceneIsActive());
 	_totalTime += dt;
+	PhaseTimer::instance().begin(PhaseTimer::NAVIGATION);
 	gCamera.update(dt);
+	PhaseTimer::instance().end(PhaseTimer::NAVIGATION);
 	
 	if (!gPaused)
+	{
 		BDScene::instance().update(dt);		//send the timestep to the app class
+	}
+	PhaseTimer::instance().endFrame();
+	
+	// Let the governor react to the last frame, then apply what it decided. It
+	// only sees the time spent working, sleeping between frames isn't load.
+	QualityGovernor& governor = QualityGovernor::instance();
+	governor.frame(gScheduler.getWorkTime(), dt);
+	governor.applyStateSet(BDScene::instance().getRootNode()->getOrCreateStateSet());
+	governor.applyCullSettings(viewer->getCamera());
+	for (int wall = 0; wall < C6Preview::NUM_WALLS; wall++)
+		governor.applyCullSettings(gC6Preview->getView((C6Preview::Wall)wall)->getCamera());
+	BDScene::instance().setDebugDrawSuppressed(!governor.getDebugOverlay());
 		
 	viewer->getCamera()->setClearColor(osg::Vec4f(0, 0, 0, 1.0));
-		
-	glutTimerFunc(0, timer, 0);
-	glutPostRedisplay();
+	
+	// Draw right here rather than posting a redisplay, so the frame begins and
+	// ends in this callback and GLUT's other redraws stay out of the timing
+	updateStatus();
+	glutSetWindow(gWindow);
+	drawFrame();
+	
+	// Published once the viewer has moved the stats on to this frame, so the
+	// lines sit in the same row as its cull and draw bars. Navigation still
+	// runs while paused, so the app phases are published either way.
+	osg::Stats* stats = viewer->getViewerStats();
+	int frameNumber = viewer->getFrameStamp()->getFrameNumber();
+	if (!gPaused)
+		BDScene::instance().getPhysicsProfiler()->publish(stats, frameNumber, viewer->getStartTick());
+	PhaseTimer::instance().publish(stats, frameNumber, viewer->getStartTick());
+	governor.publish(stats, frameNumber);
+	
+	// Grab the finished frame, at full size even when the governor scaled it
+	gRecorder->capture(*viewer->getCamera()->getGraphicsContext()->getState(), 0, 0, screenWidth, screenHeight);
+	
+	// Stop the clock before the swap, which waits for the vertical retrace and
+	// would make every frame look like it used the whole budget
+	gScheduler.endFrame();
+	glutSwapBuffers();
+	
+	// Come back when the next frame is due, GLUT sleeps in between
+	glutTimerFunc(gScheduler.getDelay(), timer, gScheduler.getGeneration());
+}
 
+// Input brings the scheduler out of idle. The timer armed for the next idle
+// frame can be up to a tenth of a second out, so it's replaced by one for the
+// new schedule and ignored when it fires.
+void notifyActivity()
+{
+	unsigned int generation = gScheduler.getGeneration();
+	gScheduler.notifyActivity();
+	if (gScheduler.getGeneration() != generation)
+		glutTimerFunc(gScheduler.getDelay(), timer, gScheduler.getGeneration());
 }
 
 void keyUpBoard(unsigned char key, int x, int y)
 {
+	notifyActivity();
 
-	switch(key)
-	{
-		//handle key input
-		case 'q': gCamera.setStrafeLeft(false);	break;
-		case 'w': gCamera.setUp(false);	break;
-		case 'e': gCamera.setStrafeRight(false);	break;
-		case 'a': gCamera.setLeft(false);	break;
-		case 's': gCamera.setDown(false);	break;
-		case 'd': gCamera.setRight(false);	break;
-		
-		case ' ':	BDScene::instance().buttonInput(0, false);	break;		//space bar controls the main wand button
-	}
+	KeyboardMapping::keyUp(key, gCamera);
 
 	glutPostRedisplay();
 }
@@ -413,6 +481,10 @@ void keyUpBoard(unsigned char key, int x, int y)
 
 void gamePadHandler(unsigned int buttonMask, int x, int y, int z)
 {
+	// GLUT polls the gamepad constantly, only count it when something is pressed or pushed
+	if (buttonMask != 0 || abs(x) > 50 || abs(y) > 50 || abs(z) > 50)
+		notifyActivity();
+	
 	// Button 1
 	static bool button1Pressed = false;
 	if (buttonMask & 1)
@@ -609,6 +681,7 @@ void gamePadHandler(unsigned int buttonMask, int x, int y, int z)
 	_osgNavigator.setVelocity(gmtl::Vec3f(axisX, axisUpDown, axisY));
 	
 	// Update the navigator matrices
+	PhaseTimer::Scope navigationScope(PhaseTimer::NAVIGATION);
 	_osgNavigator.update(1.0);
 	
 	// Invert the osg navigator matrix
@@ -632,7 +705,7 @@ int main( int argc, char **argv )
     glutInitDisplayMode( GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH | GLUT_ALPHA | GLUT_MULTISAMPLE );
     glutInitWindowPosition( 100, 100 );
     glutInitWindowSize( 800, 600 );
-    glutCreateWindow( argv[0] );
+    gWindow = glutCreateWindow( argv[0] );
     glutDisplayFunc(display);
     glutReshapeFunc( reshape );
     glutMouseFunc( mousebutton );
@@ -649,16 +722,88 @@ int main( int argc, char **argv )
 	// Initialize the navigator
 	_osgNavigator.init();
 
+	// Wall setup from the command line, e.g. --wall 100 50 4 --no-instancing
+	osg::ArgumentParser arguments(&argc, argv);
+	int wallColumns, wallRows, wallLayers;
+	if (arguments.read("--wall", wallColumns, wallRows, wallLayers))
+		BDScene::instance().setWallSize(wallColumns, wallRows, wallLayers);
+	if (arguments.read("--no-instancing"))
+		BDScene::instance().setUseInstancedBoxes(false);
+	
+	// Frame pacing, e.g. --frame-rate 60 --idle-rate 10
+	double frameRate;
+	if (arguments.read("--frame-rate", frameRate))
+		gScheduler.setTargetFrameRate(frameRate);
+	if (arguments.read("--idle-rate", frameRate))
+		gScheduler.setIdleFrameRate(frameRate);
+	
+	// Frame rate the quality governor holds, 0 keeps full quality
+	double targetFrameRate;
+	if (arguments.read("--target-fps", targetFrameRate))
+		QualityGovernor::instance().setTargetFrameRate(targetFrameRate);
+	
+	// Recording output, e.g. --record-to session --record-ppm
+	gRecorder = new FrameRecorder();
+	std::string recordPrefix;
+	if (arguments.read("--record-to", recordPrefix))
+		gRecorder->setOutputPrefix(recordPrefix);
+	if (arguments.read("--record-ppm"))
+		gRecorder->setFormat(FrameEncoder::IMAGE_SEQUENCE);
+
+	// Stereo, e.g. --stereo --eye-separation 0.065 --convergence 5
+	gStereo = new SinglePassStereo();
+	double stereoDistance;
+	if (arguments.read("--eye-separation", stereoDistance))
+		gStereo->setEyeSeparation(stereoDistance);
+	if (arguments.read("--convergence", stereoDistance))
+		gStereo->setConvergenceDistance(stereoDistance);
+	if (arguments.read("--stereo"))
+		gStereo->setEnabled(true);
+
     // create the view of the scene.
     viewer = new osgViewer::Viewer;
     window = viewer->setUpViewerAsEmbeddedInWindow(100,100,800,600);
 	BDScene::instance().setMaster(true);
 	BDScene::instance().init();
-    viewer->setSceneData(BDScene::instance().getRootNode());
+	gStereo->addChild(BDScene::instance().getRootNode());
+	gScaler = new ResolutionScaler();
+	gScaler->setScreenSize(screenWidth, screenHeight);
+	gScaler->addChild(gStereo.get());
+	osg::ref_ptr<osg::Group> sceneData = new osg::Group();
+	sceneData->addChild(gScaler.get());
+    viewer->setSceneData(sceneData.get());
 	viewer->getCamera()->setClearColor(osg::Vec4f(0.0, 0.0, 0.0, 1.0));
-
-    viewer->addEventHandler(new osgViewer::StatsHandler);
+	viewer->getCamera()->setPreDrawCallback(new GLObjectCompiler::CompileCallback);
+	
+	// Status text on top of the scene, next to the scaler so it's always drawn
+	// at the window's resolution
+	gHUD = new HUD();
+	gHUD->setScreenSize(screenWidth, screenHeight);
+	gHUD->setNodeMask(C6Preview::OVERLAY_MASK);
+	sceneData->addChild(gHUD.get());
+	GLObjectCompiler::instance().add(gHUD.get());
+
+	osg::ref_ptr<AppStatsHandler> statsHandler = new AppStatsHandler;
+	PhysicsProfiler::addStatsLines(statsHandler.get());
+	PhaseTimer::addStatsLines(statsHandler.get());
+	QualityGovernor::addStatsLines(statsHandler.get());
+    viewer->addEventHandler(statsHandler.get());
     viewer->realize();
+	
+	// The cave walls get a window of their own to keep their cameras apart from
+	// the main view's, though it's the same GLUT window underneath. Sharing the
+	// main window's context ID tells OSG it's the same GL context too, so GL
+	// objects (and the shadow map) are made once and used by both.
+	osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+	traits->x = 0;
+	traits->y = 0;
+	traits->width = screenWidth;
+	traits->height = screenHeight;
+	traits->sharedContext = window.get();
+	gC6Preview = new C6Preview(new osgViewer::GraphicsWindowEmbedded(traits.get()), 
+		BDScene::instance().getRootNode());
+	gC6Preview->getViewer()->setThreadingModel(osgViewer::ViewerBase::SingleThreaded);
+	gC6Preview->getViewer()->realize();
 	glutTimerFunc(100, timer, 0);
 	
     glutMainLoop();
@@ -0,0 +1,440 @@
+/*
+ *  mainViewer.cpp
+ *  Boeing Demo
+ *
+ *  Created by WATCH on 12/24/09.
+ *  Copyright 2009 Iowa State University. All rights reserved.
+ *
+ */
+
+// Desktop front end driven by osgViewer itself instead of GLUT. osgViewer owns
+// the window and the frame loop, so cull and draw can run on their own threads
+// while the main thread gets on with the next frame's physics. The keys, the
+// camera and the scene are the same as in the GLUT build.
+//
+// Usage: mainViewer [--c6] [--threading CullDrawThreadPerContext|DrawThreadPerContext|CullThreadPerCameraDrawThreadPerContext|SingleThreaded]
+//                   [--wall c r l] [--no-instancing] [--frame-rate fps] [--idle-rate fps] [--target-fps fps]
+//                   [--record-to prefix] [--record-ppm] [--stereo] [--eye-separation e] [--convergence d]
+//                   [model files...]
+//
+// --c6 shows all six cave walls instead of the one view, culled in parallel
+// unless another threading model is asked for. --stereo starts the single view
+// in side by side stereo, 'x' toggles it.
+//
+// Frame times against the GLUT build have never been measured, so nothing here
+// says this front end is faster. Both print the same frame time summary when
+// they exit, which is where such a comparison would come from.
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+#ifdef __APPLE__
+#  include <GLUT/glut.h>
+#else
+#  include <GL/glut.h>
+#endif
+
+#include <sstream>
+#include "BDScene.h"
+#include "HUD.h"
+#include "KeyboardMapping.h"
+#include "FrameScheduler.h"
+#include "FrameRecorder.h"
+#include "C6Preview.h"
+#include "SinglePassStereo.h"
+#include "ModelCache.h"
+#include "GLObjectCompiler.h"
+#include "QualityGovernor.h"
+#include "CameraController.h"
+
+CameraController gCamera;
+FrameScheduler gScheduler;
+bool gPaused = false;
+int gMouseX, gMouseY;
+int screenWidth = 800;
+int screenHeight = 600;
+
+osg::ref_ptr<osgViewer::Viewer> viewer;
+osg::ref_ptr<HUD> gHUD;
+osg::ref_ptr<FrameRecorder> gRecorder;
+osg::ref_ptr<C6Preview> gC6Preview;
+osg::ref_ptr<SinglePassStereo> gStereo;
+std::string gThreadingName = "DrawThreadPerContext";
+
+// Whichever viewer is running, the plain one or the six walls
+osgViewer::ViewerBase* getFrameViewer()
+{
+	return gC6Preview.valid() ? (osgViewer::ViewerBase*)gC6Preview->getViewer() : (osgViewer::ViewerBase*)viewer.get();
+}
+
+osg::Stats* getViewerStats()
+{
+	return gC6Preview.valid() ? gC6Preview->getViewer()->getViewerStats() : viewer->getViewerStats();
+}
+
+int getFrameNumber()
+{
+	return gC6Preview.valid() ? gC6Preview->getViewer()->getFrameStamp()->getFrameNumber() : viewer->getFrameStamp()->getFrameNumber();
+}
+
+osg::Timer_t getStartTick()
+{
+	return gC6Preview.valid() ? gC6Preview->getViewer()->getStartTick() : viewer->getStartTick();
+}
+
+// Times each buffer swap so the scheduler can leave it out of the work time.
+// With vsync the swap blocks until the retrace, and counted as work it would
+// make every frame look like it used the whole budget. In the threaded models
+// the swap happens on the draw thread and the main thread only waits on it when
+// the draw falls behind, so what's taken out is close rather than exact.
+class SwapTimer : public osg::GraphicsContext::SwapCallback
+{
+public:
+	virtual void swapBuffersImplementation(osg::GraphicsContext* gc)
+	{
+		double start = FrameScheduler::getTime();
+		gc->swapBuffersImplementation();
+		gScheduler.excludeTime(FrameScheduler::getTime() - start);
+	}
+};
+
+// Anything that means the next frame will look different from this one
+bool sceneIsActive()
+{
+	if (!gPaused && BDScene::instance().getNumActiveBodies() > 0)
+		return true;
+	return gCamera.isMoving();
+}
+
+void updateStatus()
+{
+	static double t = FrameScheduler::getTime();
+	static int reps = 0;
+	double tnow = FrameScheduler::getTime();
+	reps++;
+	if (tnow - t > 0.5)		//update every 500 ms
+	{
+		double fps = reps / (tnow - t);
+		t = tnow;
+		reps = 0;
+
+		std::ostringstream physics;
+		BDScene::instance().getPhysicsProfiler()->printReport(physics);
+		std::string physicsLine = physics.str();
+		physicsLine.erase(physicsLine.find_last_not_of('\n') + 1);
+
+		std::ostringstream phases;
+		PhaseTimer::instance().printReport(phases);
+		std::string phasesLine = phases.str();
+		phasesLine.erase(phasesLine.find_last_not_of('\n') + 1);
+
+		gHUD->setLinef(0, "Frame Rate:             %.2f (%s)", fps, gThreadingName.c_str());
+		gHUD->setLinef(1, "Quality:                %s", QualityGovernor::instance().getDescription().c_str());
+		gHUD->setLine(2, physicsLine);
+		gHUD->setLine(3, phasesLine);
+	}
+}
+
+// Feeds osgViewer's events to the shared key mapping and the camera. Mouse
+// positions are turned back into GLUT's coordinates (y going down) since that's
+// what the CameraController expects.
+class ViewerEventHandler : public osgGA::GUIEventHandler
+{
+public:
+	virtual bool handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa)
+	{
+		int x = (int)ea.getX();
+		int y = (int)ea.getY();
+		if (ea.getMouseYOrientation() == osgGA::GUIEventAdapter::Y_INCREASING_UPWARDS)
+			y = ea.getWindowHeight() - y;
+
+		switch (ea.getEventType())
+		{
+			case osgGA::GUIEventAdapter::KEYDOWN:
+				gScheduler.notifyActivity();
+				switch (ea.getKey())
+				{
+					case osgGA::GUIEventAdapter::KEY_Left:	return KeyboardMapping::arrowKey(KeyboardMapping::ARROW_LEFT);
+					case osgGA::GUIEventAdapter::KEY_Right:	return KeyboardMapping::arrowKey(KeyboardMapping::ARROW_RIGHT);
+					case osgGA::GUIEventAdapter::KEY_Down:	return KeyboardMapping::arrowKey(KeyboardMapping::ARROW_DOWN);
+					case osgGA::GUIEventAdapter::KEY_Up:	return KeyboardMapping::arrowKey(KeyboardMapping::ARROW_UP);
+					case osgGA::GUIEventAdapter::KEY_Tab:	return KeyboardMapping::keyDown('\t', gCamera);
+					case 'p':	gPaused = !gPaused;	return true;		//pause/unpause
+					case 'v':	gRecorder->toggleRecording();	return true;		//start/stop recording
+					case 'x':	gStereo->setEnabled(!gStereo->isEnabled());	return true;		//stereo on/off
+					default:
+						if (ea.getKey() < 256)
+							return KeyboardMapping::keyDown((unsigned char)ea.getKey(), gCamera);
+				}
+				return false;
+
+			case osgGA::GUIEventAdapter::KEYUP:
+				gScheduler.notifyActivity();
+				if (ea.getKey() < 256)
+					return KeyboardMapping::keyUp((unsigned char)ea.getKey(), gCamera);
+				return false;
+
+			case osgGA::GUIEventAdapter::PUSH:
+				gScheduler.notifyActivity();
+				gCamera.mouseClick(ea.getButton() == osgGA::GUIEventAdapter::RIGHT_MOUSE_BUTTON ? GLUT_RIGHT_BUTTON : GLUT_LEFT_BUTTON,
+					GLUT_DOWN, x, y);
+				break;
+
+			case osgGA::GUIEventAdapter::DRAG:
+				gScheduler.notifyActivity();
+				gCamera.mouseMotion(x, y);
+				break;
+
+			case osgGA::GUIEventAdapter::MOVE:
+				gScheduler.notifyActivity();
+				gCamera.passiveMouse(x, y);
+				break;
+
+			case osgGA::GUIEventAdapter::RESIZE:
+				screenWidth = ea.getWindowWidth();
+				screenHeight = ea.getWindowHeight();
+				gHUD->setScreenSize(screenWidth, screenHeight);
+				if (gC6Preview.valid())
+					gC6Preview->setScreenSize(screenWidth, screenHeight);
+				break;
+
+			default:
+				break;
+		}
+
+		// The wand follows the mouse, with y going up like in the GLUT build
+		if (ea.getEventType() & (osgGA::GUIEventAdapter::PUSH | osgGA::GUIEventAdapter::DRAG | osgGA::GUIEventAdapter::MOVE))
+		{
+			gMouseX = x;
+			gMouseY = screenHeight - y;
+		}
+		return false;
+	}
+};
+
+int main( int argc, char **argv )
+{
+	osg::ArgumentParser arguments(&argc, argv);
+
+	// Six cave walls instead of one view
+	bool showC6 = arguments.read("--c6");
+
+	// Which threads cull and draw. DrawThreadPerContext lets the next frame's
+	// update overlap this frame's draw, which is only safe because everything
+	// that changes after setup is marked DYNAMIC. The walls default to a cull
+	// thread each on top of that.
+	osgViewer::ViewerBase::ThreadingModel threadingModel = osgViewer::ViewerBase::DrawThreadPerContext;
+	if (showC6)
+	{
+		threadingModel = osgViewer::ViewerBase::CullThreadPerCameraDrawThreadPerContext;
+		gThreadingName = "CullThreadPerCameraDrawThreadPerContext";
+	}
+	std::string threading;
+	if (arguments.read("--threading", threading))
+	{
+		if (threading == "CullDrawThreadPerContext")
+			threadingModel = osgViewer::ViewerBase::CullDrawThreadPerContext;
+		else if (threading == "DrawThreadPerContext")
+			threadingModel = osgViewer::ViewerBase::DrawThreadPerContext;
+		else if (threading == "CullThreadPerCameraDrawThreadPerContext")
+			threadingModel = osgViewer::ViewerBase::CullThreadPerCameraDrawThreadPerContext;
+		else if (threading == "SingleThreaded")
+			threadingModel = osgViewer::ViewerBase::SingleThreaded;
+		else
+		{
+			// Keep the default for this layout, and say which one that is
+			std::cout << "Unknown threading model " << threading << ", using " << gThreadingName << std::endl;
+			threading = gThreadingName;
+		}
+		gThreadingName = threading;
+	}
+
+	// Wall setup from the command line, e.g. --wall 100 50 4 --no-instancing
+	int wallColumns, wallRows, wallLayers;
+	if (arguments.read("--wall", wallColumns, wallRows, wallLayers))
+		BDScene::instance().setWallSize(wallColumns, wallRows, wallLayers);
+	if (arguments.read("--no-instancing"))
+		BDScene::instance().setUseInstancedBoxes(false);
+
+	// Frame pacing, e.g. --frame-rate 60 --idle-rate 10
+	double frameRate;
+	if (arguments.read("--frame-rate", frameRate))
+		gScheduler.setTargetFrameRate(frameRate);
+	if (arguments.read("--idle-rate", frameRate))
+		gScheduler.setIdleFrameRate(frameRate);
+
+	// Frame rate the quality governor holds, 0 keeps full quality
+	double targetFrameRate;
+	if (arguments.read("--target-fps", targetFrameRate))
+		QualityGovernor::instance().setTargetFrameRate(targetFrameRate);
+
+	// Recording output, e.g. --record-to session --record-ppm
+	gRecorder = new FrameRecorder();
+	std::string recordPrefix;
+	if (arguments.read("--record-to", recordPrefix))
+		gRecorder->setOutputPrefix(recordPrefix);
+	if (arguments.read("--record-ppm"))
+		gRecorder->setFormat(FrameEncoder::IMAGE_SEQUENCE);
+
+	// Stereo for the single view, e.g. --stereo --eye-separation 0.065 --convergence 5
+	gStereo = new SinglePassStereo();
+	double stereoDistance;
+	if (arguments.read("--eye-separation", stereoDistance))
+		gStereo->setEyeSeparation(stereoDistance);
+	if (arguments.read("--convergence", stereoDistance))
+		gStereo->setConvergenceDistance(stereoDistance);
+	if (arguments.read("--stereo"))
+		gStereo->setEnabled(true);
+
+	BDScene::instance().setMaster(true);
+	BDScene::instance().init();
+	gStereo->addChild(BDScene::instance().getRootNode());
+
+	// Anything else on the command line goes through the model cache too, which
+	// prints what the mesh optimizer did for it
+	for (int i = 1; i < arguments.argc(); i++)
+	{
+		if (!arguments.isOption(i))
+			ModelCache::instance().preload(arguments[i]);
+	}
+
+	// Status text on top of the scene, left off the cave walls
+	gHUD = new HUD();
+	gHUD->setScreenSize(screenWidth, screenHeight);
+	gHUD->setNodeMask(C6Preview::OVERLAY_MASK);
+	BDScene::instance().getRootNode()->addChild(gHUD.get());
+	GLObjectCompiler::instance().add(gHUD.get());
+
+	// 's' moves the camera, so the stats go on 'i'
+	osg::ref_ptr<AppStatsHandler> statsHandler = new AppStatsHandler;
+	statsHandler->setKeyEventTogglesOnScreenStats('i');
+	PhysicsProfiler::addStatsLines(statsHandler.get());
+	PhaseTimer::addStatsLines(statsHandler.get());
+	QualityGovernor::addStatsLines(statsHandler.get());
+	osg::ref_ptr<ViewerEventHandler> eventHandler = new ViewerEventHandler;
+
+	if (showC6)
+	{
+		// One window with room for the 4 x 3 layout
+		screenWidth = 1200;
+		screenHeight = 900;
+		osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+		traits->x = 100;
+		traits->y = 100;
+		traits->width = screenWidth;
+		traits->height = screenHeight;
+		traits->windowDecoration = true;
+		traits->doubleBuffer = true;
+		traits->windowName = "C6 Preview";
+		osg::ref_ptr<osg::GraphicsContext> context = osg::GraphicsContext::createGraphicsContext(traits.get());
+		if (!context.valid())
+		{
+			std::cout << "Couldn't open a window for the C6 preview" << std::endl;
+			return 1;
+		}
+
+		gC6Preview = new C6Preview(context.get(), BDScene::instance().getRootNode());
+		gC6Preview->getViewer()->setThreadingModel(threadingModel);
+		gHUD->setScreenSize(screenWidth, screenHeight);
+
+		// Events go to whichever wall the mouse is over. The ceiling is drawn
+		// last, so it records the whole window.
+		for (int wall = 0; wall < C6Preview::NUM_WALLS; wall++)
+			gC6Preview->getView((C6Preview::Wall)wall)->addEventHandler(eventHandler.get());
+		gC6Preview->getView(C6Preview::FRONT)->addEventHandler(statsHandler.get());
+		gRecorder->setCaptureWholeWindow(true);
+		gC6Preview->getView(C6Preview::CEILING)->getCamera()->setFinalDrawCallback(gRecorder.get());
+		gC6Preview->getViewer()->realize();
+	}
+	else
+	{
+		// create the view of the scene.
+		viewer = new osgViewer::Viewer;
+		viewer->setThreadingModel(threadingModel);
+		viewer->setUpViewInWindow(100, 100, screenWidth, screenHeight);
+		viewer->setSceneData(gStereo.get());
+		viewer->getCamera()->setClearColor(osg::Vec4f(0.0, 0.0, 0.0, 1.0));
+		viewer->getCamera()->setProjectionMatrixAsPerspective(60, 1.0 * screenWidth / screenHeight, 0.1, 5000.0);
+		viewer->getCamera()->setPreDrawCallback(new GLObjectCompiler::CompileCallback);
+		viewer->getCamera()->setFinalDrawCallback(gRecorder.get());
+
+		viewer->addEventHandler(statsHandler.get());
+		viewer->addEventHandler(new osgViewer::WindowSizeHandler);
+		viewer->addEventHandler(eventHandler.get());
+		viewer->realize();
+	}
+
+	osgViewer::ViewerBase* frameViewer = getFrameViewer();
+	osgViewer::ViewerBase::Windows windows;
+	frameViewer->getWindows(windows);
+	for (osgViewer::ViewerBase::Windows::iterator it = windows.begin(); it != windows.end(); ++it)
+		(*it)->setSwapCallback(new SwapTimer);
+	while (!frameViewer->done())
+	{
+		float dt = gScheduler.beginFrame(sceneIsActive());
+		PhaseTimer::instance().begin(PhaseTimer::NAVIGATION);
+		gCamera.update(dt);
+		PhaseTimer::instance().end(PhaseTimer::NAVIGATION);
+
+		if (!gPaused)
+		{
+			BDScene::instance().update(dt);		//send the timestep to the app class
+		}
+
+		// Same governor as the GLUT build, less the resolution scale: the window
+		// belongs to osgViewer here, so there's nothing to upscale into
+		QualityGovernor& governor = QualityGovernor::instance();
+		governor.frame(gScheduler.getWorkTime(), dt);
+		governor.applyStateSet(BDScene::instance().getRootNode()->getOrCreateStateSet());
+		if (gC6Preview.valid())
+		{
+			for (int wall = 0; wall < C6Preview::NUM_WALLS; wall++)
+				governor.applyCullSettings(gC6Preview->getView((C6Preview::Wall)wall)->getCamera());
+		}
+		else
+			governor.applyCullSettings(viewer->getCamera());
+		BDScene::instance().setDebugDrawSuppressed(!governor.getDebugOverlay());
+
+		// The camera math is on the CPU and cached, see CameraController
+		PhaseTimer::instance().begin(PhaseTimer::NAVIGATION);
+		BDScene::instance().setHeadMatrix(osg::Matrixf(gCamera.getViewMatrix(CameraController::FPS_VIEW).getInverse().m));
+		KMatrix wandMat = gCamera.getWandMatrix(Vec3(-1.0 + 2.0 * gMouseX / screenWidth, -1.0 + 2.0 * gMouseY / screenHeight, -2));
+		BDScene::instance().setWandMatrix(osg::Matrixf(wandMat.m));
+		if (gC6Preview.valid())
+			gC6Preview->setHeadMatrix(osg::Matrixf(gCamera.getViewMatrix(CameraController::FPS_VIEW).m));
+		else
+			viewer->getCamera()->setViewMatrix(osg::Matrixf(gCamera.getViewMatrix().m));
+		PhaseTimer::instance().end(PhaseTimer::NAVIGATION);
+
+		PhaseTimer::instance().endFrame();
+
+		updateStatus();
+
+		// Returns once the dynamic objects are drawn, the draw thread finishes the
+		// rest while we go around again
+		frameViewer->frame();
+
+		// Published once frame() has moved the stats on to this frame, so the
+		// lines sit in the same row as its cull and draw bars. Navigation still
+		// runs while paused, so the app phases are published either way.
+		if (!gPaused)
+			BDScene::instance().getPhysicsProfiler()->publish(getViewerStats(), getFrameNumber(), getStartTick());
+		PhaseTimer::instance().publish(getViewerStats(), getFrameNumber(), getStartTick());
+		governor.publish(getViewerStats(), getFrameNumber());
+
+		gScheduler.endFrame();
+		gScheduler.waitForNextFrame();
+	}
+
+	gScheduler.printSummary("osgViewer " + gThreadingName);
+
+	// One more frame lets the recorder drain its ring while the context is still here
+	if (gRecorder->isRecording())
+	{
+		gRecorder->setRecording(false);
+		frameViewer->setDone(false);
+		frameViewer->frame();
+	}
+
+	return 0;
+}
@@ -150,6 +150,7 @@
 #include <osg/Notify>
 #include <osg/Object>
 #include <osg/OccluderNode>
+#include <osg/OcclusionQueryNode>
 #include <osg/PagedLOD>
 #include <osg/Plane>
 #include <osg/Point>